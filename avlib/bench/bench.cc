@@ -0,0 +1,357 @@
+// Benchmarks of the native stages on clips synthesized with software
+// encoders. Writes one JSON record per stage, codec and resolution, and
+// checks that the YuvToRgb fast path stays within a tolerance of swscale.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "converter.hh"
+#include "decoder.hh"
+#include "demuxer.hh"
+#include "encoder.hh"
+#include "generator.hh"
+
+struct Clip {
+  std::string encoder;
+  std::string decoder;
+  std::string extension;
+  int width;
+  int height;
+
+  std::string Name() const {
+    return Format(encoder, '_', width, 'x', height);
+  }
+};
+
+struct Result {
+  std::string stage;
+  std::string clip;
+  std::size_t frames;
+  std::size_t bytes;
+  double seconds;
+};
+
+struct FastPathCheck {
+  AVPixelFormat src;
+  AVPixelFormat dst;
+  AVColorSpace space;
+  AVColorRange range;
+  int width;
+  int height;
+  int max_error;
+};
+
+// Largest per-channel difference allowed between the YuvToRgb fast path and
+// swscale, which rounds through 8-bit lookup tables.
+constexpr int kFastPathTolerance = 3;
+
+using Clock = std::chrono::steady_clock;
+
+static double Seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Diagonal gradients moving at different speeds per plane, so the encoders
+// see motion but the clip stays reproducible.
+static void Paint(const Frame& frame, int index) {
+  for (int plane = 0; plane < 3; ++plane) {
+    auto shift = plane == 0 ? 0 : 1;
+    auto width = frame->width >> shift;
+    auto height = frame->height >> shift;
+    for (int y = 0; y < height; ++y) {
+      auto row = frame->data[plane] + y * frame->linesize[plane];
+      for (int x = 0; x < width; ++x) {
+        row[x] = static_cast<uint8_t>(x + y + (plane + 1) * index);
+      }
+    }
+  }
+}
+
+// Converts random luma over smooth chroma gradients with and without the
+// fast path. Chroma is kept smooth so that any chroma filtering in swscale
+// does not count as error.
+static FastPathCheck CheckFastPath(AVPixelFormat src_format,
+                                   AVPixelFormat dst_format,
+                                   AVColorSpace space, AVColorRange range,
+                                   int width, int height) {
+  Frame src{src_format, width, height};
+  src->colorspace = space;
+  src->color_range = range;
+  std::mt19937 random{1};
+  std::uniform_int_distribution<int> byte{0, 255};
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      src->data[0][y * src->linesize[0] + x] = byte(random);
+    }
+  }
+  auto chroma_width = (width + 1) / 2;
+  auto chroma_height = (height + 1) / 2;
+  for (int y = 0; y < chroma_height; ++y) {
+    for (int x = 0; x < chroma_width; ++x) {
+      auto u = static_cast<uint8_t>(x * 255 / std::max(chroma_width - 1, 1));
+      auto v = static_cast<uint8_t>(y * 255 / std::max(chroma_height - 1, 1));
+      if (src_format == AV_PIX_FMT_NV12) {
+        src->data[1][y * src->linesize[1] + 2 * x] = u;
+        src->data[1][y * src->linesize[1] + 2 * x + 1] = v;
+      } else {
+        src->data[1][y * src->linesize[1] + x] = u;
+        src->data[2][y * src->linesize[2] + x] = v;
+      }
+    }
+  }
+  auto stride = width * (dst_format == AV_PIX_FMT_RGBA ? 4 : 3);
+  std::vector<uint8_t> fast(static_cast<std::size_t>(stride) * height);
+  std::vector<uint8_t> reference(fast.size());
+  for (auto fast_path : {true, false}) {
+    ScaleOptions options{};
+    options.fast_path = fast_path;
+    Converter converter{dst_format, width, height, options};
+    converter.Convert(src, (fast_path ? fast : reference).data(), stride);
+  }
+  int max_error = 0;
+  for (std::size_t i = 0; i < fast.size(); ++i) {
+    max_error = std::max(max_error, std::abs(fast[i] - reference[i]));
+  }
+  return {src_format, dst_format, space, range, width, height, max_error};
+}
+
+static std::vector<FastPathCheck> CheckFastPaths() {
+  std::vector<FastPathCheck> checks{};
+  for (auto src : {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12}) {
+    for (auto dst : {AV_PIX_FMT_RGBA, AV_PIX_FMT_RGB24}) {
+      for (auto space : {AVCOL_SPC_BT470BG, AVCOL_SPC_BT709}) {
+        for (auto range : {AVCOL_RANGE_MPEG, AVCOL_RANGE_JPEG}) {
+          for (auto [width, height] : {std::pair{640, 360},
+                                       std::pair{641, 361},
+                                       std::pair{37, 9}}) {
+            checks.push_back(
+                CheckFastPath(src, dst, space, range, width, height));
+          }
+        }
+      }
+    }
+  }
+  return checks;
+}
+
+// Encodes `frames` frames into a raw elementary stream at `path`.
+static Result Synthesize(const Clip& clip, const std::string& path,
+                         int frames) {
+  CodecConfig config{};
+  config.format = AV_PIX_FMT_YUV420P;
+  config.width = clip.width;
+  config.height = clip.height;
+  config.timebase = AVRational{1, 25};
+  config.framerate = AVRational{25, 1};
+  config.gop_size = 25;
+  config.max_b_frames = 0;
+  config.bitrate = clip.width * clip.height * 2;
+  // One thread keeps the output identical from run to run.
+  config.thread_count = 1;
+  if (clip.encoder == "libx264") {
+    config.SetOption("preset", "veryfast");
+  }
+  Encoder encoder{clip.encoder, config};
+  // Painted up front so that only the encoder is timed.
+  std::vector<Frame> painted{};
+  for (int i = 0; i < frames; ++i) {
+    auto& frame =
+        painted.emplace_back(AV_PIX_FMT_YUV420P, clip.width, clip.height);
+    Paint(frame, i);
+    frame->pts = i;
+  }
+  std::vector<Packet> packets{};
+  auto start = Clock::now();
+  for (auto& frame : painted) {
+    encoder.Send(frame);
+    for (auto packet = encoder.Receive(); packet; packet = encoder.Receive()) {
+      packets.push_back(std::move(*packet));
+    }
+  }
+  encoder.Flush();
+  for (auto packet = encoder.Receive(); packet; packet = encoder.Receive()) {
+    packets.push_back(std::move(*packet));
+  }
+  auto seconds = Seconds(start);
+  std::ofstream out{path, std::ios::binary | std::ios::trunc};
+  std::size_t bytes = 0;
+  for (auto& packet : packets) {
+    out.write(reinterpret_cast<const char*>(packet->data), packet->size);
+    bytes += packet->size;
+  }
+  if (!out) {
+    Throw("could not write ", path);
+  }
+  return {"encode", clip.Name(), static_cast<std::size_t>(frames), bytes,
+          seconds};
+}
+
+static void Run(const Clip& clip, const std::string& clips, int frames,
+                std::vector<Result>& results) {
+  auto path = Format(clips, '/', clip.Name(), '.', clip.extension);
+  results.push_back(Synthesize(clip, path, frames));
+
+  Demuxer demuxer{path};
+  auto stream = demuxer.FindBestStream(AVMEDIA_TYPE_VIDEO);
+  if (stream == nullptr) {
+    Throw("could not find video stream in ", path);
+  }
+  std::vector<Packet> packets{};
+  std::size_t bytes = 0;
+  auto start = Clock::now();
+  for (auto packet = demuxer.Read(stream); packet;
+       packet = demuxer.Read(stream)) {
+    bytes += (*packet)->size;
+    packets.push_back(std::move(*packet));
+  }
+  results.push_back({"demux", clip.Name(), packets.size(), bytes,
+                     Seconds(start)});
+
+  Decoder decoder{clip.decoder, stream};
+  std::vector<Frame> decoded{};
+  start = Clock::now();
+  decoder.Decode(decoded, packets);
+  decoder.Flush();
+  for (auto frame = decoder.Receive(); frame; frame = decoder.Receive()) {
+    decoded.push_back(std::move(*frame));
+  }
+  results.push_back({"decode", clip.Name(), decoded.size(), bytes,
+                     Seconds(start)});
+  if (decoded.empty()) {
+    Throw("no frames decoded from ", path);
+  }
+  // A few frames are enough to convert and bound the memory at 1080p.
+  decoded.resize(std::min<std::size_t>(decoded.size(), 16));
+
+  for (auto fast_path : {true, false}) {
+    ScaleOptions options{};
+    options.fast_path = fast_path;
+    Converter converter{AV_PIX_FMT_RGBA, clip.width, clip.height, options};
+    auto stride = clip.width * 4;
+    std::vector<uint8_t> rgba(static_cast<std::size_t>(stride) * clip.height);
+    start = Clock::now();
+    for (int i = 0; i < frames; ++i) {
+      converter.Convert(decoded[i % decoded.size()], rgba.data(), stride);
+    }
+    results.push_back({fast_path ? "convert_rgba" : "convert_rgba_swscale",
+                       clip.Name(), static_cast<std::size_t>(frames),
+                       static_cast<std::size_t>(frames) * rgba.size(),
+                       Seconds(start)});
+  }
+
+  if (clip.encoder != "libx264") {
+    return;
+  }
+  GeneratorOptions options{};
+  options.decoder = clip.decoder;
+  options.encoder = clip.encoder;
+  options.seed = 1;
+  options.all_damaged = true;
+  Generator generator{path, clip.width, clip.height, options};
+  auto size = generator.SampleSize();
+  std::vector<uint8_t> x(size);
+  std::vector<uint8_t> y(size);
+  std::size_t samples = 0;
+  start = Clock::now();
+  while (generator.GenerateSample(x.data(), y.data())) {
+    ++samples;
+  }
+  results.push_back({"generate", clip.Name(), samples, 2 * samples * size,
+                     Seconds(start)});
+}
+
+static void WriteJson(const std::string& path,
+                      const std::vector<Result>& results,
+                      const std::vector<FastPathCheck>& checks) {
+  std::ofstream out{path, std::ios::trunc};
+  out << "{\n  \"suite\": \"native\",\n  \"avcodec\": \"" << LIBAVCODEC_IDENT
+      << "\",\n  \"results\": [";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    auto& r = results[i];
+    out << (i ? "," : "") << "\n    {\"stage\": \"" << r.stage
+        << "\", \"clip\": \"" << r.clip << "\", \"frames\": " << r.frames
+        << ", \"bytes\": " << r.bytes << ", \"seconds\": " << r.seconds
+        << ", \"frames_per_second\": " << r.frames / r.seconds
+        << ", \"bytes_per_second\": " << r.bytes / r.seconds << "}";
+  }
+  out << "\n  ],\n  \"fast_path_tolerance\": " << kFastPathTolerance
+      << ",\n  \"fast_path\": [";
+  for (std::size_t i = 0; i < checks.size(); ++i) {
+    auto& c = checks[i];
+    out << (i ? "," : "") << "\n    {\"src\": \""
+        << av_get_pix_fmt_name(c.src) << "\", \"dst\": \""
+        << av_get_pix_fmt_name(c.dst) << "\", \"space\": \""
+        << av_color_space_name(c.space) << "\", \"range\": \""
+        << av_color_range_name(c.range) << "\", \"width\": " << c.width
+        << ", \"height\": " << c.height << ", \"max_error\": " << c.max_error
+        << "}";
+  }
+  out << "\n  ]\n}\n";
+  if (!out) {
+    Throw("could not write ", path);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  std::string clips = "bench_clips";
+  std::string output = "bench_native.json";
+  int frames = 120;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "--clips") == 0) {
+      clips = argv[i + 1];
+    } else if (std::strcmp(argv[i], "--output") == 0) {
+      output = argv[i + 1];
+    } else if (std::strcmp(argv[i], "--frames") == 0) {
+      frames = std::stoi(argv[i + 1]);
+    } else {
+      std::cerr << "usage: " << argv[0]
+                << " [--clips DIR] [--output FILE] [--frames N]\n";
+      return 2;
+    }
+  }
+  std::filesystem::create_directories(clips);
+  std::vector<Clip> suite{};
+  for (auto [width, height] : {std::pair{640, 360}, std::pair{1280, 720},
+                               std::pair{1920, 1080}}) {
+    suite.push_back({"libx264", "h264", "h264", width, height});
+    suite.push_back({"mpeg4", "mpeg4", "m4v", width, height});
+  }
+  std::vector<Result> results{};
+  std::vector<FastPathCheck> checks{};
+  try {
+    checks = CheckFastPaths();
+    for (auto& clip : suite) {
+      Run(clip, clips, frames, results);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+  for (auto& r : results) {
+    std::cout << r.clip << ' ' << r.stage << ": " << r.frames / r.seconds
+              << " frames/s, " << r.bytes / r.seconds / 1e6 << " MB/s\n";
+  }
+  int failed = 0;
+  for (auto& c : checks) {
+    if (kFastPathTolerance < c.max_error) {
+      std::cerr << "fast path " << av_get_pix_fmt_name(c.src) << " to "
+                << av_get_pix_fmt_name(c.dst) << ' '
+                << av_color_space_name(c.space) << ' '
+                << av_color_range_name(c.range) << ' ' << c.width << 'x'
+                << c.height << " differs from swscale by " << c.max_error
+                << '\n';
+      ++failed;
+    }
+  }
+  WriteJson(output, results, checks);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,288 @@
+"""Benchmarks of the Python bindings on the clips written by avlib_bench.
+
+Runs the stages of the native suite through the module so that the two JSON
+files show the binding overhead, plus the numpy import and export of frames.
+Also decodes N copies of each h264 clip on N Python threads to check that the
+bindings release the GIL, and runs the ParallelGenerator with N workers to
+check that it scales. Either fails the run when N-way throughput falls below
+--min-efficiency times N times the one-way throughput.
+"""
+
+import argparse
+import concurrent.futures
+import json
+import pathlib
+import re
+import shutil
+import sys
+import time
+
+import avlib as av
+import numpy as np
+
+CLIP = re.compile(r"(?P<encoder>\w+?)_(?P<width>\d+)x(?P<height>\d+)$")
+DECODERS = {"libx264": "h264", "mpeg4": "mpeg4"}
+
+
+# Plane shapes and item sizes of a 64x36 frame in formats beyond 8-bit 4:2:0.
+PLANES = {
+    "YUV422P": ([(36, 64), (36, 32), (36, 32)], 1),
+    "YUV444P": ([(36, 64), (36, 64), (36, 64)], 1),
+    "YUV420P10LE": ([(36, 64), (18, 32), (18, 32)], 2),
+    "P010LE": ([(36, 64), (18, 32, 2)], 2),
+    "GRAY16LE": ([(36, 64)], 2),
+    "RGB48LE": ([(36, 64, 3)], 2),
+}
+
+
+def check_planes():
+  for name, (shapes, itemsize) in PLANES.items():
+    frame = av.Frame(getattr(av.PixelFormat, name), (64, 36))
+    planes = frame.planes()
+    assert [p.shape for p in planes] == shapes, (name, planes)
+    assert all(p.dtype.itemsize == itemsize for p in planes), name
+
+
+def check_import():
+  rgb = np.arange(36 * 64 * 3, dtype=np.uint8).reshape(36, 64, 3)
+  frame = av.Frame(av.PixelFormat.RGB24, rgb)
+  assert (frame.planes()[0] == rgb).all()
+  # A strided view takes the element copy path.
+  frame = av.Frame(av.PixelFormat.RGB24, rgb[:, ::-1])
+  assert (frame.planes()[0] == rgb[:, ::-1]).all()
+  yuv = [np.full((36, 64), value, dtype=np.uint8) for value in (16, 128, 240)]
+  for frame in (av.Frame(av.PixelFormat.YUV444P, yuv),
+                av.Frame.wrap(av.PixelFormat.YUV444P, yuv)):
+    assert all((p == q).all() for p, q in zip(frame.planes(), yuv))
+
+
+def timed(results, stage, clip, fn):
+  start = time.perf_counter()
+  frames, size = fn()
+  seconds = time.perf_counter() - start
+  results.append({
+      "stage": stage,
+      "clip": clip,
+      "frames": frames,
+      "bytes": size,
+      "seconds": seconds,
+      "frames_per_second": frames / seconds,
+      "bytes_per_second": size / seconds,
+  })
+
+
+def run(path, encoder, width, height, frames, results):
+  clip = path.stem
+  demuxer = av.Demuxer(str(path))
+  stream = demuxer.find_best_stream(av.MediaType.VIDEO)
+  packets = []
+
+  def demux():
+    while (packet := demuxer.read(stream)) is not None:
+      packets.append(packet)
+    return len(packets), sum(p.size for p in packets)
+
+  timed(results, "demux", clip, demux)
+  size = sum(p.size for p in packets)
+  decoded = []
+
+  def decode():
+    decoder = av.Decoder(DECODERS[encoder], stream)
+    decoded.extend(decoder.decode(packets))
+    decoder.flush()
+    decoded.extend(decoder)
+    return len(decoded), size
+
+  timed(results, "decode", clip, decode)
+  decoded = decoded[:16]
+
+  for fast_path in (True, False):
+    converter = av.Converter(av.PixelFormat.RGBA, (width, height),
+                             fast_path=fast_path)
+    output = av.Frame(av.PixelFormat.RGBA, (width, height))
+
+    # Converts into one frame, as the native suite reuses one buffer.
+    def convert():
+      for i in range(frames):
+        converter.convert(decoded[i % len(decoded)], output)
+      return frames, frames * width * height * 4
+
+    stage = "convert_rgba" if fast_path else "convert_rgba_swscale"
+    timed(results, stage, clip, convert)
+
+  # RGB24 takes the fast path as well and fills three bytes per pixel.
+  rgb = av.Converter(av.PixelFormat.RGB24, (width, height))
+  batch = rgb.convert_batch(decoded)
+  assert batch.shape == (len(decoded), height, width, 3), batch.shape
+  for frame, sample in zip(decoded, batch):
+    assert (rgb.convert(frame).planes()[0] == sample).all()
+
+  def convert_batch():
+    for _ in range(frames // len(decoded)):
+      rgb.convert_batch(decoded, batch)
+    count = frames // len(decoded) * len(decoded)
+    return count, count * width * height * 3
+
+  timed(results, "convert_batch_rgb24", clip, convert_batch)
+
+  # Every frame converted into a new frame is one pool request, hit or miss.
+  pool = av.FramePool.shared()
+  requests = pool.requests
+  rgba = [converter.convert(frame) for frame in decoded]
+  assert pool.requests - requests == len(rgba), (pool.requests, requests)
+  assert pool.hits + pool.misses == pool.requests
+  arrays = []
+
+  def export():
+    arrays[:] = [rgba[i % len(rgba)].planes()[0] for i in range(frames)]
+    return frames, frames * width * height * 4
+
+  timed(results, "frame_export", clip, export)
+
+  def wrap():
+    for array in arrays:
+      av.Frame.wrap(av.PixelFormat.RGBA, array)
+    return frames, frames * width * height * 4
+
+  timed(results, "frame_wrap", clip, wrap)
+
+  def copy():
+    for array in arrays:
+      av.Frame(av.PixelFormat.RGBA, array)
+    return frames, frames * width * height * 4
+
+  timed(results, "frame_copy", clip, copy)
+
+  if encoder != "libx264":
+    return
+  generator = av.Generator(str(path), frame_size=(width, height),
+                           batch_size=8, decoder=DECODERS[encoder],
+                           encoder=encoder, seed=1, all_damaged=True)
+
+  def generate():
+    samples = 0
+    size = 0
+    while True:
+      x, y = generator.generate_batch()
+      if x is None:
+        return samples, size
+      samples += len(x)
+      size += x.nbytes + y.nbytes
+
+  timed(results, "generate", clip, generate)
+
+
+def decode_file(path, decoder):
+  # One codec thread each, so any speedup comes from the Python threads.
+  config = av.CodecConfig()
+  config.thread_count = 1
+  demuxer = av.Demuxer(str(path))
+  stream = demuxer.find_best_stream(av.MediaType.VIDEO)
+  decoder = av.Decoder(decoder, config, stream)
+  frames = 0
+  while (packet := demuxer.read(stream)) is not None:
+    frames += len(decoder.decode(packet))
+  decoder.flush()
+  return frames + sum(1 for _ in decoder)
+
+
+def decode_threads(path, encoder, threads, results):
+  """Decodes N copies of the clip on N threads; returns the speedups."""
+  copies = path.parent / "threads"
+  copies.mkdir(exist_ok=True)
+  speedups = {}
+  for n in threads:
+    paths = []
+    for i in range(n):
+      copy = copies / f"{path.stem}-{i}{path.suffix}"
+      if not copy.exists():
+        shutil.copyfile(path, copy)
+      paths.append(copy)
+
+    def decode():
+      with concurrent.futures.ThreadPoolExecutor(n) as pool:
+        frames = sum(pool.map(decode_file, paths, [DECODERS[encoder]] * n))
+      return frames, n * path.stat().st_size
+
+    timed(results, f"decode_{n}_threads", path.stem, decode)
+    speedups[n] = results[-1]["frames_per_second"]
+  base = speedups[threads[0]] / threads[0]
+  for n in threads:
+    speedups[n] /= base
+  return speedups
+
+
+def parallel_generate(path, encoder, width, height, workers, results):
+  """Runs the ParallelGenerator with N workers; returns the speedups."""
+  speedups = {}
+  for n in workers:
+    generator = av.ParallelGenerator(str(path), frame_size=(width, height),
+                                     batch_size=8, workers=n,
+                                     decoder=DECODERS[encoder],
+                                     encoder=encoder, seed=1,
+                                     all_damaged=True)
+
+    def generate():
+      samples = 0
+      size = 0
+      while True:
+        x, y = generator.generate_batch()
+        if x is None:
+          return samples, size
+        samples += len(x)
+        size += x.nbytes + y.nbytes
+
+    timed(results, f"parallel_generate_{n}_workers", path.stem, generate)
+    speedups[n] = results[-1]["frames_per_second"]
+  base = speedups[workers[0]] / workers[0]
+  for n in workers:
+    speedups[n] /= base
+  return speedups
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__)
+  parser.add_argument("--clips", type=pathlib.Path, default="bench_clips")
+  parser.add_argument("--output", type=pathlib.Path,
+                      default="bench_python.json")
+  parser.add_argument("--frames", type=int, default=120)
+  parser.add_argument("--threads", type=int, nargs="+", default=[1, 2, 4])
+  parser.add_argument("--min-efficiency", type=float, default=0.7,
+                      help="fail if N threads decode, or N workers generate, "
+                      "slower than this fraction of N times one")
+  args = parser.parse_args()
+
+  check_planes()
+  check_import()
+  results = []
+  failures = []
+  for path in sorted(args.clips.iterdir()):
+    match = CLIP.match(path.stem)
+    if match is None or match["encoder"] not in DECODERS:
+      continue
+    run(path, match["encoder"], int(match["width"]), int(match["height"]),
+        args.frames, results)
+    if match["encoder"] == "libx264":
+      for n, speedup in decode_threads(path, match["encoder"], args.threads,
+                                       results).items():
+        print(f"{path.stem} {n} threads: {speedup:.2f}x")
+        if speedup < args.min_efficiency * n:
+          failures.append(f"{path.stem}: {n} threads only {speedup:.2f}x")
+      for n, speedup in parallel_generate(path, match["encoder"],
+                                          int(match["width"]),
+                                          int(match["height"]), args.threads,
+                                          results).items():
+        print(f"{path.stem} {n} workers: {speedup:.2f}x")
+        if speedup < args.min_efficiency * n:
+          failures.append(f"{path.stem}: {n} workers only {speedup:.2f}x")
+  for r in results:
+    print(f"{r['clip']} {r['stage']}: {r['frames_per_second']:.1f} frames/s, "
+          f"{r['bytes_per_second'] / 1e6:.1f} MB/s")
+  args.output.write_text(
+      json.dumps({"suite": "python", "results": results}, indent=2) + "\n")
+  if failures:
+    sys.exit("scaling below --min-efficiency:\n" + "\n".join(failures))
+
+
+if __name__ == "__main__":
+  main()
@@ -4,8 +4,17 @@
 #include "demuxer.hh"
 #include "encoder.hh"
 #include "frame.hh"
+#include "frame_reader.hh"
+#include "frame_pool.hh"
 #include "generator.hh"
+#include "keyframe_index.hh"
+#include "keyframe_scanner.hh"
+#include "layout_converter.hh"
 #include "packet.hh"
+#include "parallel_generator.hh"
+#include "pipeline.hh"
+#include "profiler.hh"
+#include "shard.hh"
 
 PYBIND11_MODULE(avlib, m) {
   m.doc() = "ffmpeg bindings";
@@ -14,13 +23,33 @@ PYBIND11_MODULE(avlib, m) {
 
   py::enum_<AVPixelFormat>(m, "PixelFormat")
       .value("YUV420P", AV_PIX_FMT_YUV420P)
+      .value("YUV422P", AV_PIX_FMT_YUV422P)
+      .value("YUV444P", AV_PIX_FMT_YUV444P)
+      .value("YUV420P10LE", AV_PIX_FMT_YUV420P10LE)
+      .value("YUV422P10LE", AV_PIX_FMT_YUV422P10LE)
+      .value("YUV444P10LE", AV_PIX_FMT_YUV444P10LE)
+      .value("YUV420P12LE", AV_PIX_FMT_YUV420P12LE)
       .value("NV12", AV_PIX_FMT_NV12)
+      .value("NV21", AV_PIX_FMT_NV21)
+      .value("P010LE", AV_PIX_FMT_P010LE)
+      .value("P016LE", AV_PIX_FMT_P016LE)
+      .value("YUYV422", AV_PIX_FMT_YUYV422)
+      .value("UYVY422", AV_PIX_FMT_UYVY422)
+      .value("GRAY10LE", AV_PIX_FMT_GRAY10LE)
+      .value("GRAY16LE", AV_PIX_FMT_GRAY16LE)
+      .value("GRAY8", AV_PIX_FMT_GRAY8)
+      .value("PAL8", AV_PIX_FMT_PAL8)
+      .value("RGB24", AV_PIX_FMT_RGB24)
+      .value("BGR24", AV_PIX_FMT_BGR24)
+      .value("GBRP", AV_PIX_FMT_GBRP)
       .value("ARGB", AV_PIX_FMT_ARGB)
       .value("RGBA", AV_PIX_FMT_RGBA)
       .value("ABGR", AV_PIX_FMT_ABGR)
       .value("BGRA", AV_PIX_FMT_BGRA)
       .value("RGB32", AV_PIX_FMT_RGB32)
-      .value("BGR32", AV_PIX_FMT_BGR32);
+      .value("BGR32", AV_PIX_FMT_BGR32)
+      .value("RGB48LE", AV_PIX_FMT_RGB48LE)
+      .value("RGBA64LE", AV_PIX_FMT_RGBA64LE);
 
   py::enum_<AVPictureType>(m, "PictureType")
       .value("NONE", AV_PICTURE_TYPE_NONE)
@@ -57,12 +86,22 @@ PYBIND11_MODULE(avlib, m) {
         return Format("<avlib.Rational ", r.num, "/", r.den, ">");
       });
 
+  Profiler::Register(m);
   Packet::Register(m);
   Frame::Register(m);
+  FramePool::Register(m);
   Demuxer::Register(m);
+  KeyframeIndex::Register(m);
   CodecConfig::Register(m);
   Encoder::Register(m);
   Decoder::Register(m);
+  FrameReader::Register(m);
+  KeyframeScanner::Register(m);
   Converter::Register(m);
+  LayoutConverter::Register(m);
   Generator::Register(m);
+  ParallelGenerator::Register(m);
+  Pipeline::Register(m);
+  ShardWriter::Register(m);
+  ShardLoader::Register(m);
 }
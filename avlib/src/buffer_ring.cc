@@ -0,0 +1,38 @@
+#include "buffer_ring.hh"
+
+BufferRing::BufferRing(std::size_t size, std::size_t capacity)
+    : size_{size}, capacity_{capacity} {
+  free_.reserve(capacity_);
+}
+
+std::unique_ptr<uint8_t[]> BufferRing::Acquire() {
+  {
+    std::lock_guard lock{mutex_};
+    if (!free_.empty()) {
+      auto buffer = std::move(free_.back());
+      free_.pop_back();
+      return buffer;
+    }
+  }
+  return std::unique_ptr<uint8_t[]>{new uint8_t[size_]};
+}
+
+void BufferRing::Release(std::unique_ptr<uint8_t[]> buffer) noexcept {
+  std::lock_guard lock{mutex_};
+  if (buffer && free_.size() < capacity_) {
+    free_.push_back(std::move(buffer));
+  }
+}
+
+std::size_t BufferRing::Size() const noexcept {
+  return size_;
+}
+
+std::size_t BufferRing::Capacity() const noexcept {
+  return capacity_;
+}
+
+std::size_t BufferRing::Available() const {
+  std::lock_guard lock{mutex_};
+  return free_.size();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Keeps up to `capacity` released buffers of `size` bytes for reuse so that
+// large batch buffers are not allocated and page-faulted on every call.
+// Buffers are handed out uninitialized.
+class BufferRing {
+ public:
+  explicit BufferRing(std::size_t size, std::size_t capacity);
+  BufferRing(const BufferRing& other) = delete;
+  BufferRing& operator=(const BufferRing& other) = delete;
+
+  std::unique_ptr<uint8_t[]> Acquire();
+  void Release(std::unique_ptr<uint8_t[]> buffer) noexcept;
+
+  std::size_t Size() const noexcept;
+  std::size_t Capacity() const noexcept;
+  std::size_t Available() const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<uint8_t[]>> free_;
+  std::size_t size_;
+  std::size_t capacity_;
+};
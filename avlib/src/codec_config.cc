@@ -4,6 +4,18 @@ void CodecConfig::SetFlag(Flag flag) {
   flags = flags.value_or(0) | static_cast<int>(flag);
 }
 
+void CodecConfig::SetFlag2(Flag2 flag) {
+  flags2 = flags2.value_or(0) | static_cast<int>(flag);
+}
+
+void CodecConfig::SetThreadType(ThreadType type) {
+  thread_type = static_cast<int>(type);
+}
+
+void CodecConfig::SetOption(std::string_view name, std::string_view value) {
+  options[std::string{name}] = value;
+}
+
 void CodecConfig::Apply(AVCodecContext* ctx) const {
   ctx->pix_fmt = format.value_or(ctx->pix_fmt);
   ctx->framerate = framerate.value_or(ctx->framerate);
@@ -16,15 +28,100 @@ void CodecConfig::Apply(AVCodecContext* ctx) const {
   ctx->max_b_frames = max_b_frames.value_or(ctx->max_b_frames);
   ctx->refs = refs.value_or(ctx->refs);
   ctx->flags = flags.value_or(ctx->flags);
+  ctx->flags2 = flags2.value_or(ctx->flags2);
+  ctx->thread_count = thread_count.value_or(ctx->thread_count);
+  ctx->thread_type = thread_type.value_or(ctx->thread_type);
+  auto discard = [](const std::optional<Discard>& value, AVDiscard current) {
+    return value ? static_cast<AVDiscard>(*value) : current;
+  };
+  ctx->skip_frame = discard(skip_frame, ctx->skip_frame);
+  ctx->skip_loop_filter = discard(skip_loop_filter, ctx->skip_loop_filter);
+  ctx->skip_idct = discard(skip_idct, ctx->skip_idct);
+  ctx->lowres = lowres.value_or(ctx->lowres);
+}
+
+void CodecConfig::Open(AVCodecContext* ctx, const AVCodec* codec) const {
+  AVDictionary* dict = nullptr;
+  for (auto& [name, value] : options) {
+    av_dict_set(&dict, name.c_str(), value.c_str(), 0);
+  }
+  auto ret = avcodec_open2(ctx, codec, &dict);
+  auto unused = av_dict_get(dict, "", nullptr, AV_DICT_IGNORE_SUFFIX);
+  std::string name = unused ? unused->key : "";
+  av_dict_free(&dict);
+  CheckError(ret);
+  if (unused) {
+    Throw("unknown codec option ", name);
+  }
+}
+
+std::string CodecConfig::Describe() const {
+  std::stringstream str;
+  auto field = [&](const char* name, const auto& value) {
+    if (value) {
+      str << name << '=' << *value << ';';
+    }
+  };
+  auto discard = [&](const char* name, const std::optional<Discard>& d) {
+    if (d) {
+      str << name << '=' << static_cast<int>(*d) << ';';
+    }
+  };
+  auto rational = [&](const char* name, const std::optional<AVRational>& r) {
+    if (r) {
+      str << name << '=' << r->num << '/' << r->den << ';';
+    }
+  };
+  field("format", format);
+  rational("framerate", framerate);
+  rational("timebase", timebase);
+  field("width", width);
+  field("height", height);
+  field("bitrate", bitrate);
+  field("gop_size", gop_size);
+  field("keyint_min", keyint_min);
+  field("max_b_frames", max_b_frames);
+  field("refs", refs);
+  field("flags", flags);
+  field("flags2", flags2);
+  field("thread_count", thread_count);
+  field("thread_type", thread_type);
+  discard("skip_frame", skip_frame);
+  discard("skip_loop_filter", skip_loop_filter);
+  discard("skip_idct", skip_idct);
+  field("lowres", lowres);
+  for (auto& [name, value] : options) {
+    str << name << '=' << value << ';';
+  }
+  return str.str();
 }
 
 void CodecConfig::Register(py::module_& m) {
   auto c = py::class_<CodecConfig>(m, "CodecConfig");
 
   py::enum_<Flag>(c, "Flag").value("LOW_DELAY", Flag::LOW_DELAY);
+  py::enum_<Flag2>(c, "Flag2").value("FAST", Flag2::FAST);
+  py::enum_<Discard>(c, "Discard")
+      .value("NONE", Discard::NONE)
+      .value("DEFAULT", Discard::DEFAULT)
+      .value("NONREF", Discard::NONREF)
+      .value("BIDIR", Discard::BIDIR)
+      .value("NONINTRA", Discard::NONINTRA)
+      .value("NONKEY", Discard::NONKEY)
+      .value("ALL", Discard::ALL);
+  py::enum_<ThreadType>(c, "ThreadType")
+      .value("FRAME", ThreadType::FRAME)
+      .value("SLICE", ThreadType::SLICE);
 
   c.def(py::init([] { return CodecConfig{}; }));
   c.def("set_flag", &CodecConfig::SetFlag);
+  c.def("set_flag2", &CodecConfig::SetFlag2);
+  c.def("__repr__", [](const CodecConfig& config) {
+    return Format("<avlib.CodecConfig ", config.Describe(), ">");
+  });
+  c.def("set_thread_type", &CodecConfig::SetThreadType);
+  c.def("set_option", &CodecConfig::SetOption, py::arg("name"),
+        py::arg("value"));
 
   c.def_readwrite("format", &CodecConfig::format);
   c.def_readwrite("framerate", &CodecConfig::framerate);
@@ -37,4 +134,12 @@ void CodecConfig::Register(py::module_& m) {
   c.def_readwrite("max_b_frames", &CodecConfig::max_b_frames);
   c.def_readwrite("refs", &CodecConfig::refs);
   c.def_readonly("flags", &CodecConfig::flags);
+  c.def_readonly("flags2", &CodecConfig::flags2);
+  c.def_readwrite("thread_count", &CodecConfig::thread_count);
+  c.def_readonly("thread_type", &CodecConfig::thread_type);
+  c.def_readwrite("skip_frame", &CodecConfig::skip_frame);
+  c.def_readwrite("skip_loop_filter", &CodecConfig::skip_loop_filter);
+  c.def_readwrite("skip_idct", &CodecConfig::skip_idct);
+  c.def_readwrite("lowres", &CodecConfig::lowres);
+  c.def_readonly("options", &CodecConfig::options);
 }
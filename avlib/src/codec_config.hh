@@ -1,6 +1,8 @@
 #pragma once
 
+#include <map>
 #include <optional>
+#include <string>
 
 #include "common.hh"
 
@@ -9,6 +11,25 @@ struct CodecConfig {
     LOW_DELAY = AV_CODEC_FLAG_LOW_DELAY,
   };
 
+  enum class Flag2 : int {
+    FAST = AV_CODEC_FLAG2_FAST,
+  };
+
+  enum class ThreadType : int {
+    FRAME = FF_THREAD_FRAME,
+    SLICE = FF_THREAD_SLICE,
+  };
+
+  enum class Discard : int {
+    NONE = AVDISCARD_NONE,
+    DEFAULT = AVDISCARD_DEFAULT,
+    NONREF = AVDISCARD_NONREF,
+    BIDIR = AVDISCARD_BIDIR,
+    NONINTRA = AVDISCARD_NONINTRA,
+    NONKEY = AVDISCARD_NONKEY,
+    ALL = AVDISCARD_ALL,
+  };
+
   std::optional<AVPixelFormat> format;
   std::optional<AVRational> framerate;
   std::optional<AVRational> timebase;
@@ -20,9 +41,29 @@ struct CodecConfig {
   std::optional<int> max_b_frames;
   std::optional<int> refs;
   std::optional<int> flags;
+  std::optional<int> flags2;
+  std::optional<int> thread_count;
+  std::optional<int> thread_type;
+  // Decoder speed settings: frames to skip entirely, frames to decode
+  // without the loop filter or without IDCT, and a power of two to
+  // downscale by while decoding.
+  std::optional<Discard> skip_frame;
+  std::optional<Discard> skip_loop_filter;
+  std::optional<Discard> skip_idct;
+  std::optional<int> lowres;
+  // Generic and private codec options passed to avcodec_open2. Read-only in
+  // Python, where the map is returned as a copy; use set_option.
+  std::map<std::string, std::string> options;
 
   void SetFlag(Flag flag);
+  void SetFlag2(Flag2 flag);
+  // Restricts threading to one type; unset, libavcodec allows both.
+  void SetThreadType(ThreadType type);
+  void SetOption(std::string_view name, std::string_view value);
   void Apply(AVCodecContext* ctx) const;
+  void Open(AVCodecContext* ctx, const AVCodec* codec) const;
+  // Lists every set field and option, e.g. to key caches of encoder output.
+  std::string Describe() const;
 
   static void Register(py::module_& m);
 };
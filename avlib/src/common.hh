@@ -1,5 +1,7 @@
 #pragma once
 
+#include <filesystem>
+#include <optional>
 #include <random>
 #include <sstream>
 #include <stdexcept>
@@ -37,10 +39,44 @@ std::string Format(Args&&... args) {
     Throw(buffer);                 \
   }
 
+// Size and modification time of a file, used to invalidate caches derived
+// from it.
+struct FileStamp {
+  uint64_t size;
+  int64_t mtime;
+
+  bool operator==(const FileStamp& other) const noexcept {
+    return size == other.size && mtime == other.mtime;
+  }
+};
+
+inline FileStamp StampFile(std::string_view filename) {
+  std::filesystem::path path{std::string{filename}};
+  return {std::filesystem::file_size(path),
+          static_cast<int64_t>(std::filesystem::last_write_time(path)
+                                   .time_since_epoch()
+                                   .count())};
+}
+
+// AVBuffer free callback for buffers wrapping Python objects. `opaque` is a
+// heap-allocated py::object pinning the exporter.
+inline void ReleasePyObject(void* opaque, uint8_t*) {
+  py::gil_scoped_acquire acquire{};
+  delete static_cast<py::object*>(opaque);
+}
+
+// Releases a buffer export held as AVBuffer opaque. Holding the export, not
+// just the object, keeps exporters such as bytearray from resizing.
+inline void ReleaseBufferInfo(void* opaque, uint8_t*) {
+  py::gil_scoped_acquire acquire{};
+  delete static_cast<py::buffer_info*>(opaque);
+}
+
 template <typename Tp, typename = std::enable_if_t<std::is_integral_v<Tp>>>
 class Random {
  public:
-  explicit Random(Tp min, Tp max) : dist_{min, max} {}
+  explicit Random(Tp min, Tp max, std::optional<unsigned> seed = std::nullopt)
+      : engine_{seed ? *seed : device_()}, dist_{min, max} {}
 
   Tp operator()() {
     return dist_(engine_);
@@ -48,6 +84,6 @@ class Random {
 
  private:
   inline static thread_local std::random_device device_{};
-  inline static thread_local std::default_random_engine engine_{device_()};
+  std::default_random_engine engine_;
   std::uniform_int_distribution<Tp> dist_;
 };
@@ -2,21 +2,81 @@
 
 #include <utility>
 
-Converter::Converter(AVPixelFormat format, int width, int height)
-    : format_{format}, width_{width}, height_{height} {}
+#include "exclusive.hh"
+#include "profiler.hh"
+
+// sws_scale runs single-threaded even with the "threads" option set; only
+// sws_scale_frame splits the conversion into slices across the pool.
+#define SLICE_THREADS (LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100))
+
+static const char* DitherName(Dither dither) {
+  switch (dither) {
+    case Dither::NONE:
+      return "none";
+    case Dither::BAYER:
+      return "bayer";
+    case Dither::ED:
+      return "ed";
+    case Dither::A_DITHER:
+      return "a_dither";
+    case Dither::X_DITHER:
+      return "x_dither";
+    default:
+      return "auto";
+  }
+}
+
+int ScaleOptions::Flags() const noexcept {
+  auto flags = static_cast<int>(algorithm);
+  if (accurate_rounding) {
+    flags |= SWS_ACCURATE_RND;
+  }
+  if (full_chroma) {
+    flags |= SWS_FULL_CHR_H_INT | SWS_FULL_CHR_H_INP;
+  }
+  return flags;
+}
+
+Converter::Converter(AVPixelFormat format, int width, int height,
+                     const ScaleOptions& options)
+    : pool_{FramePool::Shared()},
+      format_{format},
+      width_{width},
+      height_{height},
+      options_{options} {}
 
 Converter::Converter(Converter&& other) noexcept
-    : ctx_{std::exchange(other.ctx_, nullptr)},
+    : pool_{std::move(other.pool_)},
+      ctx_{std::exchange(other.ctx_, nullptr)},
       format_{other.format_},
       width_{other.width_},
-      height_{other.height_} {}
+      height_{other.height_},
+      options_{other.options_},
+      fast_{std::move(other.fast_)},
+      src_format_{other.src_format_},
+      src_space_{other.src_space_},
+      src_range_{other.src_range_},
+      src_width_{other.src_width_},
+      src_height_{other.src_height_},
+      batch_pool_{std::move(other.batch_pool_)},
+      batch_workers_{std::move(other.batch_workers_)} {}
 
 Converter& Converter::operator=(Converter&& other) noexcept {
   sws_freeContext(ctx_);
+  pool_ = std::move(other.pool_);
   ctx_ = std::exchange(other.ctx_, nullptr);
   format_ = other.format_;
   width_ = other.width_;
   height_ = other.height_;
+  options_ = other.options_;
+  fast_ = std::move(other.fast_);
+  src_format_ = other.src_format_;
+  src_space_ = other.src_space_;
+  src_range_ = other.src_range_;
+  src_width_ = other.src_width_;
+  src_height_ = other.src_height_;
+  batch_pool_ = std::move(other.batch_pool_);
+  batch_workers_ = std::move(other.batch_workers_);
   return *this;
 }
 
@@ -24,15 +84,102 @@ Converter::~Converter() noexcept {
   sws_freeContext(ctx_);
 }
 
+// Recreates the scaler when the source format, colorspace or size changes.
+void Converter::Configure(const Frame& src) {
+  auto format = static_cast<AVPixelFormat>(src->format);
+  if ((ctx_ || fast_) && src_format_ == format &&
+      src_space_ == src->colorspace && src_range_ == src->color_range &&
+      src_width_ == src->width && src_height_ == src->height) {
+    return;
+  }
+  sws_freeContext(ctx_);
+  ctx_ = nullptr;
+  fast_.reset();
+  src_format_ = format;
+  src_space_ = src->colorspace;
+  src_range_ = src->color_range;
+  src_width_ = src->width;
+  src_height_ = src->height;
+  if (options_.fast_path && !options_.full_chroma && width_ == src->width &&
+      height_ == src->height && YuvToRgb::Supported(format, format_)) {
+    fast_.emplace(format, format_, src->colorspace, src->color_range);
+    return;
+  }
+  ctx_ = sws_alloc_context();
+  if (ctx_ == nullptr) {
+    Throw("could not allocate scaler");
+  }
+  CheckError(av_opt_set_int(ctx_, "srcw", src->width, 0));
+  CheckError(av_opt_set_int(ctx_, "srch", src->height, 0));
+  CheckError(av_opt_set_int(ctx_, "src_format", format, 0));
+  CheckError(av_opt_set_int(ctx_, "dstw", width_, 0));
+  CheckError(av_opt_set_int(ctx_, "dsth", height_, 0));
+  CheckError(av_opt_set_int(ctx_, "dst_format", format_, 0));
+  CheckError(av_opt_set_int(ctx_, "sws_flags", options_.Flags(), 0));
+  CheckError(av_opt_set(ctx_, "sws_dither", DitherName(options_.dither), 0));
+#if SLICE_THREADS
+  CheckError(av_opt_set_int(ctx_, "threads", options_.threads, 0));
+#endif
+  auto ret = sws_init_context(ctx_, nullptr, nullptr);
+  if (ret < 0) {
+    sws_freeContext(ctx_);
+    ctx_ = nullptr;
+    CheckError(ret);
+  }
+  // Match the fast path: honor BT.709 tags and full range input.
+  int* inv_table = nullptr;
+  int* table = nullptr;
+  int src_full = 0;
+  int dst_full = 0;
+  int brightness = 0;
+  int contrast = 0;
+  int saturation = 0;
+  if (0 <= sws_getColorspaceDetails(ctx_, &inv_table, &src_full, &table,
+                                    &dst_full, &brightness, &contrast,
+                                    &saturation)) {
+    auto coefficients = sws_getCoefficients(
+        src->colorspace == AVCOL_SPC_BT709 ? SWS_CS_ITU709 : SWS_CS_DEFAULT);
+    src_full |= src->color_range == AVCOL_RANGE_JPEG;
+    sws_setColorspaceDetails(ctx_, coefficients, src_full, table, dst_full,
+                             brightness, contrast, saturation);
+  }
+}
+
 void Converter::Convert(const Frame& src, Frame& dst) {
   Convert(src, dst->data, dst->linesize);
 }
 
 void Converter::Convert(const Frame& src, uint8_t* const dst_data[],
                         const int dst_stride[]) {
-  ctx_ = sws_getCachedContext(
-      ctx_, src->width, src->height, static_cast<AVPixelFormat>(src->format),
-      width_, height_, format_, SWS_BICUBIC, nullptr, nullptr, nullptr);
+  static auto& stage = Profiler::Stage("converter.convert");
+  ProfileScope scope{stage};
+  scope.Add(0, 1);
+  Configure(src);
+  if (fast_) {
+    fast_->Convert(*src, dst_data, dst_stride);
+    return;
+  }
+#if SLICE_THREADS
+  if (options_.threads != 1) {
+    // sws_scale_frame allocates a destination without buffers, so the
+    // caller's planes are wrapped in a buffer that is never freed.
+    Frame dst{};
+    dst->format = format_;
+    dst->width = width_;
+    dst->height = height_;
+    for (int i = 0; i < av_pix_fmt_count_planes(format_); ++i) {
+      dst->data[i] = dst_data[i];
+      dst->linesize[i] = dst_stride[i];
+    }
+    dst->buf[0] = av_buffer_create(
+        dst_data[0], 0, [](void*, uint8_t*) {}, nullptr, 0);
+    if (dst->buf[0] == nullptr) {
+      Throw("could not wrap destination");
+    }
+    CheckError(sws_scale_frame(ctx_, *dst, *src));
+    return;
+  }
+#endif
   sws_scale(ctx_, src->data, src->linesize, 0, src->height, dst_data,
             dst_stride);
 }
@@ -44,24 +191,135 @@ void Converter::Convert(const Frame& src, void* dst_data, int dst_stride) {
 }
 
 Frame Converter::Convert(const Frame& src) {
-  Frame frame{format_, width_, height_};
+  auto frame = pool_->Allocate(format_, width_, height_);
   Convert(src, frame);
   return frame;
 }
 
+void Converter::ConvertBatch(const std::vector<Frame>& frames, uint8_t* dst,
+                             std::size_t threads) {
+  auto stride = width_ * PixelSize();
+  auto sample = stride * height_;
+  if (!batch_pool_ || (threads && batch_pool_->Size() != threads)) {
+    batch_workers_.clear();
+    batch_pool_ = std::make_unique<ThreadPool>(threads);
+  }
+  if (batch_workers_.empty()) {
+    auto options = options_;
+    options.threads = 1;
+    for (std::size_t i = 0; i < batch_pool_->Size(); ++i) {
+      batch_workers_.emplace_back(format_, width_, height_, options);
+    }
+  }
+  batch_pool_->ParallelFor(frames.size(), [&](std::size_t i,
+                                               std::size_t worker) {
+    batch_workers_[worker].Convert(frames[i], dst + i * sample,
+                                   static_cast<int>(stride));
+  });
+}
+
+std::size_t Converter::PixelSize() const {
+  auto desc = av_pix_fmt_desc_get(format_);
+  if (desc == nullptr || av_pix_fmt_count_planes(format_) != 1 ||
+      desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM |
+                     AV_PIX_FMT_FLAG_HWACCEL)) {
+    Throw("batch output requires a packed format");
+  }
+  for (int i = 0; i < desc->nb_components; ++i) {
+    if (desc->comp[i].depth != 8) {
+      Throw("batch output requires 8-bit components");
+    }
+  }
+  return av_get_padded_bits_per_pixel(desc) / 8;
+}
+
 void Converter::Register(py::module_& m) {
+  py::enum_<ScaleAlgorithm>(m, "ScaleAlgorithm")
+      .value("FAST_BILINEAR", ScaleAlgorithm::FAST_BILINEAR)
+      .value("BILINEAR", ScaleAlgorithm::BILINEAR)
+      .value("BICUBIC", ScaleAlgorithm::BICUBIC)
+      .value("POINT", ScaleAlgorithm::POINT)
+      .value("AREA", ScaleAlgorithm::AREA)
+      .value("GAUSS", ScaleAlgorithm::GAUSS)
+      .value("LANCZOS", ScaleAlgorithm::LANCZOS)
+      .value("SPLINE", ScaleAlgorithm::SPLINE);
+
+  py::enum_<Dither>(m, "Dither")
+      .value("AUTO", Dither::AUTO)
+      .value("NONE", Dither::NONE)
+      .value("BAYER", Dither::BAYER)
+      .value("ED", Dither::ED)
+      .value("A_DITHER", Dither::A_DITHER)
+      .value("X_DITHER", Dither::X_DITHER);
+
   auto c = py::class_<Converter>(m, "Converter");
 
-  c.def(py::init([](AVPixelFormat format, std::pair<int, int> size) {
-          return Converter{format, size.first, size.second};
+  c.def(py::init([](AVPixelFormat format, std::pair<int, int> size,
+                    ScaleAlgorithm algorithm, bool accurate_rounding,
+                    bool full_chroma, Dither dither, int threads,
+                    bool fast_path) {
+          ScaleOptions options{};
+          options.algorithm = algorithm;
+          options.accurate_rounding = accurate_rounding;
+          options.full_chroma = full_chroma;
+          options.dither = dither;
+          options.threads = threads;
+          options.fast_path = fast_path;
+          return Converter{format, size.first, size.second, options};
         }),
-        py::arg("format"), py::arg("size"));
+        py::arg("format"), py::arg("size"),
+        py::arg("algorithm") = ScaleAlgorithm::BICUBIC,
+        py::arg("accurate_rounding") = false, py::arg("full_chroma") = false,
+        py::arg("dither") = Dither::AUTO, py::arg("threads") = 1,
+        py::arg("fast_path") = true);
 
   c.def("convert",
-        static_cast<void (Converter::*)(const Frame&, Frame&)>(
-            &Converter::Convert),
+        Exclusive(static_cast<void (Converter::*)(const Frame&, Frame&)>(
+            &Converter::Convert)),
         py::arg("src"), py::arg("dst"));
   c.def("convert",
-        static_cast<Frame (Converter::*)(const Frame&)>(&Converter::Convert),
+        Exclusive(static_cast<Frame (Converter::*)(const Frame&)>(
+            &Converter::Convert)),
         py::arg("src"));
+  c.def(
+      "convert_batch",
+      [](Converter& cv, const std::vector<Frame>& frames,
+         const std::optional<py::buffer>& out, std::size_t threads) {
+        ExclusiveScope scope{&cv};
+        std::vector<ssize_t> shape{static_cast<ssize_t>(frames.size()),
+                                   cv.height_, cv.width_,
+                                   static_cast<ssize_t>(cv.PixelSize())};
+        auto size = shape[0] * shape[1] * shape[2] * shape[3];
+        py::object result;
+        std::optional<py::buffer_info> info;
+        uint8_t* dst = nullptr;
+        if (out) {
+          info = out->request(true);
+          auto stride = info->itemsize;
+          for (auto i = info->ndim - 1; 0 <= i; --i) {
+            if (info->shape[i] != 1 && info->strides[i] != stride) {
+              Throw("output buffer must be C-contiguous");
+            }
+            stride *= info->shape[i];
+          }
+          if (info->itemsize != 1 || stride != size) {
+            Throw("output buffer has ", stride, " bytes of item size ",
+                  info->itemsize, ", expected ", size, " bytes");
+          }
+          dst = static_cast<uint8_t*>(info->ptr);
+          result = *out;
+        } else {
+          py::array_t<uint8_t> array{shape};
+          dst = array.mutable_data();
+          result = std::move(array);
+        }
+        {
+          py::gil_scoped_release release{};
+          cv.ConvertBatch(frames, dst, threads);
+        }
+        return result;
+      },
+      py::arg("frames"), py::arg("out") = py::none{}, py::arg("threads") = 0);
+  c.def_property_readonly("pool",
+                          [](const Converter& cv) { return cv.pool_; });
 }
@@ -1,11 +1,55 @@
 #pragma once
 
+#include <memory>
+#include <optional>
+#include <vector>
+
 #include "common.hh"
 #include "frame.hh"
+#include "frame_pool.hh"
+#include "thread_pool.hh"
+#include "yuv_to_rgb.hh"
+
+enum class ScaleAlgorithm : int {
+  FAST_BILINEAR = SWS_FAST_BILINEAR,
+  BILINEAR = SWS_BILINEAR,
+  BICUBIC = SWS_BICUBIC,
+  POINT = SWS_POINT,
+  AREA = SWS_AREA,
+  GAUSS = SWS_GAUSS,
+  LANCZOS = SWS_LANCZOS,
+  SPLINE = SWS_SPLINE,
+};
+
+enum class Dither : int {
+  AUTO,
+  NONE,
+  BAYER,
+  ED,
+  A_DITHER,
+  X_DITHER,
+};
+
+struct ScaleOptions {
+  ScaleAlgorithm algorithm{ScaleAlgorithm::BICUBIC};
+  bool accurate_rounding{false};
+  // Full resolution chroma interpolation on input and output.
+  bool full_chroma{false};
+  Dither dither{Dither::AUTO};
+  // Slice threads of one conversion; 0 picks the number of cores. Needs
+  // libswscale 6.1, older versions convert on the calling thread.
+  int threads{1};
+  // Same-size YUV420P/NV12 to RGB(A) conversions use the YuvToRgb kernels
+  // instead of swscale unless full chroma interpolation is requested.
+  bool fast_path{true};
+
+  int Flags() const noexcept;
+};
 
 class Converter {
  public:
-  explicit Converter(AVPixelFormat format, int width, int height);
+  explicit Converter(AVPixelFormat format, int width, int height,
+                     const ScaleOptions& options = {});
   Converter(const Converter& other) = delete;
   Converter(Converter&& other) noexcept;
   Converter& operator=(const Converter& other) = delete;
@@ -17,12 +61,30 @@ class Converter {
                const int dst_stride[]);
   void Convert(const Frame& src, void* dst_data, int dst_stride);
   Frame Convert(const Frame& src);
+  // Converts frame i into slot i of a contiguous N x H x W x C buffer on a
+  // pool of `threads` workers, each with its own scaler.
+  void ConvertBatch(const std::vector<Frame>& frames, uint8_t* dst,
+                    std::size_t threads = 0);
+  // Bytes per pixel of a packed output format with 8-bit components.
+  std::size_t PixelSize() const;
 
   static void Register(py::module_& m);
 
  private:
+  std::shared_ptr<FramePool> pool_;
   SwsContext* ctx_{nullptr};
   AVPixelFormat format_;
   int width_;
   int height_;
+  ScaleOptions options_;
+  std::optional<YuvToRgb> fast_;
+  AVPixelFormat src_format_{AV_PIX_FMT_NONE};
+  AVColorSpace src_space_{AVCOL_SPC_UNSPECIFIED};
+  AVColorRange src_range_{AVCOL_RANGE_UNSPECIFIED};
+  int src_width_{0};
+  int src_height_{0};
+  std::unique_ptr<ThreadPool> batch_pool_;
+  std::vector<Converter> batch_workers_;
+
+  void Configure(const Frame& src);
 };
@@ -3,6 +3,8 @@
 #include <utility>
 
 #include "common.hh"
+#include "exclusive.hh"
+#include "profiler.hh"
 
 static const AVCodec* FindDecoderByName(std::string_view name) {
   auto codec = avcodec_find_decoder_by_name(name.data());
@@ -20,12 +22,14 @@ Decoder::Decoder(std::string_view codec, const AVStream* stream)
 
 Decoder::Decoder(const AVCodec* codec, const CodecConfig& config,
                  const AVStream* stream)
-    : ctx_{avcodec_alloc_context3(codec)} {
+    : pool_{FramePool::Shared()}, ctx_{avcodec_alloc_context3(codec)} {
   if (stream) {
     CheckError(avcodec_parameters_to_context(ctx_, stream->codecpar));
   }
   config.Apply(ctx_);
-  CheckError(avcodec_open2(ctx_, codec, nullptr));
+  ctx_->opaque = pool_.get();
+  ctx_->get_buffer2 = &FramePool::GetBuffer;
+  config.Open(ctx_, codec);
 }
 
 Decoder::Decoder(std::string_view codec, const CodecConfig& config,
@@ -33,10 +37,12 @@ Decoder::Decoder(std::string_view codec, const CodecConfig& config,
     : Decoder{FindDecoderByName(codec), config, stream} {}
 
 Decoder::Decoder(Decoder&& other) noexcept
-    : ctx_{std::exchange(other.ctx_, nullptr)} {}
+    : pool_{std::move(other.pool_)},
+      ctx_{std::exchange(other.ctx_, nullptr)} {}
 
 Decoder& Decoder::operator=(Decoder&& other) noexcept {
   avcodec_free_context(&ctx_);
+  pool_ = std::move(other.pool_);
   ctx_ = std::exchange(other.ctx_, nullptr);
   return *this;
 }
@@ -50,17 +56,45 @@ void Decoder::SetOption(std::string_view name, std::string_view value,
   CheckError(av_opt_set(ctx_->priv_data, name.data(), value.data(), flags));
 }
 
+void Decoder::SetSkipFrame(CodecConfig::Discard discard) noexcept {
+  ctx_->skip_frame = static_cast<AVDiscard>(discard);
+}
+
+void Decoder::SetSkipLoopFilter(CodecConfig::Discard discard) noexcept {
+  ctx_->skip_loop_filter = static_cast<AVDiscard>(discard);
+}
+
+void Decoder::SetSkipIdct(CodecConfig::Discard discard) noexcept {
+  ctx_->skip_idct = static_cast<AVDiscard>(discard);
+}
+
 void Decoder::Send(const Packet& packet) {
+  static auto& stage = Profiler::Stage("decoder.send");
+  ProfileScope scope{stage};
+  scope.Add(packet->size);
   CheckError(avcodec_send_packet(ctx_, *packet));
 }
 
+// Enters draining mode; remaining frames are returned by Receive.
+void Decoder::Flush() {
+  CheckError(avcodec_send_packet(ctx_, nullptr));
+}
+
+// Drops buffered frames and leaves draining mode, e.g. after a seek.
+void Decoder::Reset() noexcept {
+  avcodec_flush_buffers(ctx_);
+}
+
 bool Decoder::Receive(Frame& frame) {
+  static auto& stage = Profiler::Stage("decoder.receive");
+  ProfileScope scope{stage};
   frame.MakeWritable();
   auto ret = avcodec_receive_frame(ctx_, *frame);
   if (ret == AVERROR(EAGAIN) || ret == AVERROR(EOF)) {
     return false;
   }
   CheckError(ret);
+  scope.Add(0, 1);
   return true;
 }
 
@@ -154,25 +188,60 @@ Decoder::Iterator Decoder::end() noexcept {
 void Decoder::Register(py::module_& m) {
   auto c = py::class_<Decoder>(m, "Decoder");
 
-  c.def(py::init<std::string_view, const AVStream*>(), py::arg("codec_name"),
-        py::arg("stream") = py::none{});
-  c.def(py::init<std::string_view, const CodecConfig&, const AVStream*>(),
+  c.def(py::init([](std::string_view codec_name, const AVStream* stream) {
+          py::gil_scoped_release release{};
+          return std::make_unique<Decoder>(codec_name, stream);
+        }),
+        py::arg("codec_name"), py::arg("stream") = py::none{});
+  c.def(py::init([](std::string_view codec_name, const CodecConfig& config,
+                    const AVStream* stream) {
+          py::gil_scoped_release release{};
+          return std::make_unique<Decoder>(codec_name, config, stream);
+        }),
         py::arg("codec_name"), py::arg("config"),
         py::arg("stream") = py::none{});
 
   c.def("set_option", &Decoder::SetOption, py::arg("name"), py::arg("value"),
         py::arg("flags") = py::int_{0});
-  c.def("send", &Decoder::Send, py::arg("packet"));
-  c.def("receive", static_cast<bool (Decoder::*)(Frame&)>(&Decoder::Receive),
-        py::arg("frame"));
+  c.def("send", Exclusive(&Decoder::Send), py::arg("packet"));
+  c.def("flush", Exclusive(&Decoder::Flush));
+  c.def("reset", Exclusive(&Decoder::Reset));
   c.def("receive",
-        static_cast<std::optional<Frame> (Decoder::*)()>(&Decoder::Receive));
-  c.def("decode", static_cast<std::vector<Frame> (Decoder::*)(const Packet&)>(
-                      &Decoder::Decode));
+        Exclusive(static_cast<bool (Decoder::*)(Frame&)>(&Decoder::Receive)),
+        py::arg("frame"));
+  c.def("receive", Exclusive(static_cast<std::optional<Frame> (Decoder::*)()>(
+                       &Decoder::Receive)));
+  c.def("decode",
+        Exclusive(static_cast<std::vector<Frame> (Decoder::*)(const Packet&)>(
+            &Decoder::Decode)));
+  c.def("decode",
+        Exclusive(static_cast<std::vector<Frame> (Decoder::*)(
+                      const std::vector<Packet>&)>(&Decoder::Decode)));
   c.def(
-      "decode",
-      static_cast<std::vector<Frame> (Decoder::*)(const std::vector<Packet>&)>(
-          &Decoder::Decode));
+      "decode_many",
+      [](Decoder& d, const std::vector<py::buffer>& buffers,
+         const std::optional<std::vector<int64_t>>& pts, bool padded) {
+        if (pts && pts->size() != buffers.size()) {
+          Throw("expected ", buffers.size(), " timestamps, got ", pts->size());
+        }
+        std::vector<Packet> packets{};
+        packets.reserve(buffers.size());
+        for (std::size_t i = 0; i < buffers.size(); ++i) {
+          auto& packet = packets.emplace_back(buffers[i], padded);
+          if (pts) {
+            packet->pts = (*pts)[i];
+          }
+        }
+        std::vector<Frame> frames{};
+        {
+          ExclusiveScope scope{&d};
+          py::gil_scoped_release release{};
+          d.Decode(frames, packets);
+        }
+        return frames;
+      },
+      py::arg("buffers"), py::arg("pts") = py::none{},
+      py::arg("padded") = false);
   c.def(
       "__iter__",
       [](Decoder& d) { return py::make_iterator(d.begin(), d.end()); },
@@ -183,4 +252,24 @@ void Decoder::Register(py::module_& m) {
     return std::pair{d->width, d->height};
   });
   c.def_property_readonly("delay", [](const Decoder& d) { return d->delay; });
+  c.def_property(
+      "skip_frame",
+      [](const Decoder& d) {
+        return static_cast<CodecConfig::Discard>(d->skip_frame);
+      },
+      Exclusive(&Decoder::SetSkipFrame));
+  c.def_property(
+      "skip_loop_filter",
+      [](const Decoder& d) {
+        return static_cast<CodecConfig::Discard>(d->skip_loop_filter);
+      },
+      Exclusive(&Decoder::SetSkipLoopFilter));
+  c.def_property(
+      "skip_idct",
+      [](const Decoder& d) {
+        return static_cast<CodecConfig::Discard>(d->skip_idct);
+      },
+      Exclusive(&Decoder::SetSkipIdct));
+  c.def_property_readonly("lowres", [](const Decoder& d) { return d->lowres; });
+  c.def_property_readonly("pool", [](const Decoder& d) { return d.pool_; });
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
@@ -7,6 +8,7 @@
 #include "codec_config.hh"
 #include "common.hh"
 #include "frame.hh"
+#include "frame_pool.hh"
 #include "packet.hh"
 
 class Decoder {
@@ -24,7 +26,13 @@ class Decoder {
   ~Decoder() noexcept;
 
   void SetOption(std::string_view name, std::string_view value, int flags = 0);
+  // Discard levels may change between packets, e.g. to skim ahead.
+  void SetSkipFrame(CodecConfig::Discard discard) noexcept;
+  void SetSkipLoopFilter(CodecConfig::Discard discard) noexcept;
+  void SetSkipIdct(CodecConfig::Discard discard) noexcept;
   void Send(const Packet& packet);
+  void Flush();
+  void Reset() noexcept;
   bool Receive(Frame& frame);
   std::optional<Frame> Receive();
   void Decode(std::vector<Frame>& frames, const Packet& packet);
@@ -63,5 +71,6 @@ class Decoder {
   static void Register(py::module_& m);
 
  private:
+  std::shared_ptr<FramePool> pool_;
   AVCodecContext* ctx_{nullptr};
 };
@@ -3,23 +3,71 @@
 #include <utility>
 
 #include "common.hh"
+#include "exclusive.hh"
+#include "profiler.hh"
 
 Demuxer::Demuxer(std::string_view filename) {
   CheckError(avformat_open_input(&ctx_, filename.data(), nullptr, nullptr));
   CheckError(avformat_find_stream_info(ctx_, nullptr));
 }
 
-Demuxer::Demuxer(Demuxer&& other) noexcept
-    : ctx_{std::exchange(other.ctx_, nullptr)} {}
+Demuxer::Demuxer(std::unique_ptr<IOSource> source) : io_{std::move(source)} {
+  constexpr int kBufferSize = 1 << 16;
+  auto buffer = static_cast<uint8_t*>(av_malloc(kBufferSize));
+  if (buffer == nullptr) {
+    Throw("could not allocate io buffer");
+  }
+  avio_ = avio_alloc_context(
+      buffer, kBufferSize, 0, io_.get(), &IOSource::ReadPacket, nullptr,
+      io_->Seekable() ? &IOSource::SeekPacket : nullptr);
+  if (avio_ == nullptr) {
+    av_free(buffer);
+    Throw("could not allocate io context");
+  }
+  ctx_ = avformat_alloc_context();
+  ctx_->pb = avio_;
+  ctx_->flags |= AVFMT_FLAG_CUSTOM_IO;
+  auto ret = avformat_open_input(&ctx_, nullptr, nullptr, nullptr);
+  if (0 <= ret) {
+    ret = avformat_find_stream_info(ctx_, nullptr);
+  }
+  if (ret < 0) {
+    Close();
+    CheckError(ret);
+  }
+}
+
+// A running read-ahead thread moves along with its queued packets.
+Demuxer::Demuxer(Demuxer&& other) noexcept {
+  *this = std::move(other);
+}
 
 Demuxer& Demuxer::operator=(Demuxer&& other) noexcept {
-  avformat_close_input(&ctx_);
+  Close();
+  {
+    std::scoped_lock lock{read_ahead_mutex_, other.read_ahead_mutex_};
+    read_ahead_ = std::move(other.read_ahead_);
+  }
+  io_ = std::move(other.io_);
+  avio_ = std::exchange(other.avio_, nullptr);
   ctx_ = std::exchange(other.ctx_, nullptr);
+  read_ahead_packets_ = other.read_ahead_packets_;
+  read_ahead_bytes_ = other.read_ahead_bytes_;
   return *this;
 }
 
 Demuxer::~Demuxer() noexcept {
+  Close();
+}
+
+void Demuxer::Close() noexcept {
+  StopReadAhead();
   avformat_close_input(&ctx_);
+  if (avio_) {
+    av_freep(&avio_->buffer);
+    avio_context_free(&avio_);
+  }
+  io_.reset();
 }
 
 const AVStream* Demuxer::FindBestStream(AVMediaType type) const {
@@ -30,9 +78,105 @@ const AVStream* Demuxer::FindBestStream(AVMediaType type) const {
   return ctx_->streams[idx];
 }
 
+// Discards every stream not listed, so the demuxer skips their packets
+// instead of returning them to be filtered out.
+void Demuxer::SelectStreams(const std::vector<int>& indices) {
+  for (unsigned i = 0; i < ctx_->nb_streams; ++i) {
+    ctx_->streams[i]->discard = AVDISCARD_ALL;
+  }
+  for (auto index : indices) {
+    if (index < 0 || ctx_->nb_streams <= static_cast<unsigned>(index)) {
+      Throw("invalid stream index ", index);
+    }
+    ctx_->streams[index]->discard = AVDISCARD_DEFAULT;
+  }
+}
+
+// Starts a thread that demuxes ahead into a queue bounded by `packets` and,
+// if non-zero, by `bytes` of packet payload. Read then takes packets from the
+// queue. Seek restarts the thread.
+void Demuxer::StartReadAhead(std::size_t packets, std::size_t bytes) {
+  StopReadAhead();
+  read_ahead_packets_ = packets;
+  read_ahead_bytes_ = bytes;
+  std::shared_ptr<ReadAheadState> state{
+      new ReadAheadState{BoundedQueue<Packet>{packets, bytes}}};
+  state->thread = std::thread{&Demuxer::ReadAhead, ctx_, state.get()};
+  std::lock_guard lock{read_ahead_mutex_};
+  read_ahead_ = std::move(state);
+}
+
+// A reader on a Python source needs the GIL to finish its current read, so
+// the GIL is released while joining, e.g. when the demuxer is collected.
+void Demuxer::StopReadAhead() noexcept {
+  std::shared_ptr<ReadAheadState> state{};
+  {
+    std::lock_guard lock{read_ahead_mutex_};
+    state = std::move(read_ahead_);
+  }
+  if (!state) {
+    return;
+  }
+  state->queue.Close();
+  if (Py_IsInitialized() && PyGILState_Check()) {
+    py::gil_scoped_release release{};
+    state->thread.join();
+  } else {
+    state->thread.join();
+  }
+}
+
+std::shared_ptr<Demuxer::ReadAheadState> Demuxer::ReadAheadSnapshot() const {
+  std::lock_guard lock{read_ahead_mutex_};
+  return read_ahead_;
+}
+
+void Demuxer::ReadAhead(AVFormatContext* ctx, ReadAheadState* state) noexcept {
+  try {
+    static auto& stage = Profiler::Stage("demuxer.read_ahead");
+    for (;;) {
+      Packet packet{};
+      int ret;
+      {
+        ProfileScope scope{stage};
+        ret = av_read_frame(ctx, *packet);
+        scope.Add(0 <= ret ? packet->size : 0, 0 <= ret);
+      }
+      if (ret == AVERROR_EOF) {
+        break;
+      }
+      CheckError(ret);
+      auto size = static_cast<std::size_t>(packet->size);
+      if (!state->queue.Push(std::move(packet), size)) {
+        return;
+      }
+    }
+  } catch (...) {
+    state->error = std::current_exception();
+  }
+  state->queue.Close();
+}
+
 bool Demuxer::Read(Packet& packet, const AVStream* stream) {
+  static auto& stage = Profiler::Stage("demuxer.read");
+  ProfileScope scope{stage};
+  if (read_ahead_) {
+    auto& queue = read_ahead_->queue;
+    for (auto next = queue.Pop(); next; next = queue.Pop()) {
+      if (!stream || (*next)->stream_index == stream->index) {
+        packet = std::move(*next);
+        scope.Add(packet->size, 1);
+        return true;
+      }
+    }
+    if (read_ahead_->error) {
+      std::rethrow_exception(read_ahead_->error);
+    }
+    return false;
+  }
   while (0 <= av_read_frame(ctx_, *packet)) {
     if (!stream || packet->stream_index == stream->index) {
+      scope.Add(packet->size, 1);
       return true;
     }
     packet.Unref();
@@ -48,6 +192,31 @@ std::optional<Packet> Demuxer::Read(const AVStream* stream) {
   return std::nullopt;
 }
 
+void Demuxer::Seek(const AVStream* stream, int64_t timestamp) {
+  auto read_ahead = read_ahead_ != nullptr;
+  StopReadAhead();
+  CheckError(av_seek_frame(ctx_, stream ? stream->index : -1, timestamp,
+                           AVSEEK_FLAG_BACKWARD));
+  if (read_ahead) {
+    StartReadAhead(read_ahead_packets_, read_ahead_bytes_);
+  }
+}
+
+// Reads packets without decoding and returns keyframe timestamps in stream
+// time base. Leaves the demuxer at the end of the stream.
+std::vector<int64_t> Demuxer::ScanKeyframes(const AVStream* stream) {
+  std::vector<int64_t> keyframes{};
+  Packet packet{};
+  while (Read(packet, stream)) {
+    if (packet->flags & AV_PKT_FLAG_KEY) {
+      keyframes.push_back(packet->pts != AV_NOPTS_VALUE ? packet->pts
+                                                        : packet->dts);
+    }
+    packet.Unref();
+  }
+  return keyframes;
+}
+
 AVFormatContext* Demuxer::operator*() const noexcept {
   return ctx_;
 }
@@ -58,15 +227,70 @@ AVFormatContext* Demuxer::operator->() const noexcept {
 
 void Demuxer::Register(py::module_& m) {
   auto c = py::class_<Demuxer>(m, "Demuxer");
-  c.def(py::init<const std::string&>(), py::arg("filename"));
+  c.def(py::init([](const std::string& filename) {
+          py::gil_scoped_release release{};
+          return std::make_unique<Demuxer>(filename);
+        }),
+        py::arg("filename"));
+  // The buffer export is taken with the GIL held, probing runs without it.
+  c.def_static(
+      "from_buffer",
+      [](const py::buffer& data) {
+        auto source = std::make_unique<BufferSource>(data);
+        py::gil_scoped_release release{};
+        return Demuxer{std::move(source)};
+      },
+      py::arg("data"));
+  c.def_static(
+      "from_mmap",
+      [](std::string_view filename) {
+        return Demuxer{std::make_unique<MappedFileSource>(filename)};
+      },
+      py::arg("filename"), py::call_guard<py::gil_scoped_release>());
+  // Probing runs without the GIL; the source takes it in every callback.
+  c.def_static(
+      "from_file",
+      [](py::object file) {
+        auto source = std::make_unique<PythonSource>(std::move(file));
+        py::gil_scoped_release release{};
+        return Demuxer{std::move(source)};
+      },
+      py::arg("file"));
   c.def("find_best_stream", &Demuxer::FindBestStream,
         py::return_value_policy::reference_internal, py::arg("type"));
-  c.def(
-      "read",
-      static_cast<bool (Demuxer::*)(Packet&, const AVStream*)>(&Demuxer::Read),
-      py::arg("packet"), py::arg("stream") = py::none{});
   c.def("read",
-        static_cast<std::optional<Packet> (Demuxer::*)(const AVStream*)>(
-            &Demuxer::Read),
+        Exclusive(static_cast<bool (Demuxer::*)(Packet&, const AVStream*)>(
+            &Demuxer::Read)),
+        py::arg("packet"), py::arg("stream") = py::none{});
+  c.def("read",
+        Exclusive(
+            static_cast<std::optional<Packet> (Demuxer::*)(const AVStream*)>(
+                &Demuxer::Read)),
         py::arg("stream") = py::none{});
+  c.def("select_streams", Exclusive(&Demuxer::SelectStreams),
+        py::arg("indices"));
+  c.def("start_read_ahead", Exclusive(&Demuxer::StartReadAhead),
+        py::arg("packets"), py::arg("bytes") = 0);
+  c.def("stop_read_ahead", Exclusive(&Demuxer::StopReadAhead));
+  // Statistics may be polled from other threads while the demuxer is used.
+  c.def_property_readonly("queue_depth", [](const Demuxer& d) {
+    auto state = d.ReadAheadSnapshot();
+    return state ? state->queue.Size() : std::size_t{0};
+  });
+  c.def_property_readonly("queue_bytes", [](const Demuxer& d) {
+    auto state = d.ReadAheadSnapshot();
+    return state ? state->queue.Bytes() : std::size_t{0};
+  });
+  c.def_property_readonly("read_stalls", [](const Demuxer& d) {
+    auto state = d.ReadAheadSnapshot();
+    return state ? state->queue.PopWaits() : std::size_t{0};
+  });
+  c.def_property_readonly("read_ahead_stalls", [](const Demuxer& d) {
+    auto state = d.ReadAheadSnapshot();
+    return state ? state->queue.PushWaits() : std::size_t{0};
+  });
+  c.def("seek", Exclusive(&Demuxer::Seek), py::arg("stream"),
+        py::arg("timestamp"));
+  c.def("scan_keyframes", Exclusive(&Demuxer::ScanKeyframes),
+        py::arg("stream"));
 }
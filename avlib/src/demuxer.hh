@@ -1,15 +1,23 @@
 #pragma once
 
+#include <exception>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "common.hh"
 #include "decoder.hh"
+#include "io_source.hh"
 #include "packet.hh"
+#include "queue.hh"
 
 class Demuxer {
  public:
   explicit Demuxer(std::string_view filename);
+  explicit Demuxer(std::unique_ptr<IOSource> source);
   Demuxer(const Demuxer& other) = delete;
   Demuxer(Demuxer&& other) noexcept;
   Demuxer& operator=(const Demuxer& other) = delete;
@@ -17,8 +25,13 @@ class Demuxer {
   ~Demuxer() noexcept;
 
   const AVStream* FindBestStream(AVMediaType type) const;
+  void SelectStreams(const std::vector<int>& indices);
+  void StartReadAhead(std::size_t packets, std::size_t bytes = 0);
+  void StopReadAhead() noexcept;
   bool Read(Packet& packet, const AVStream* stream = nullptr);
   std::optional<Packet> Read(const AVStream* stream = nullptr);
+  void Seek(const AVStream* stream, int64_t timestamp);
+  std::vector<int64_t> ScanKeyframes(const AVStream* stream);
 
   AVFormatContext* operator*() const noexcept;
   AVFormatContext* operator->() const noexcept;
@@ -26,5 +39,25 @@ class Demuxer {
   static void Register(py::module_& m);
 
  private:
+  // Read-ahead thread and its queue. The thread only refers to this state
+  // and the format context, so moving the demuxer hands both over. Shared so
+  // that statistics read from other threads outlive a concurrent stop.
+  struct ReadAheadState {
+    BoundedQueue<Packet> queue;
+    std::exception_ptr error;
+    std::thread thread;
+  };
+
+  std::unique_ptr<IOSource> io_;
+  AVIOContext* avio_{nullptr};
   AVFormatContext* ctx_{nullptr};
+  std::shared_ptr<ReadAheadState> read_ahead_;
+  // Guards replacing `read_ahead_` against ReadAheadSnapshot.
+  mutable std::mutex read_ahead_mutex_;
+  std::size_t read_ahead_packets_{0};
+  std::size_t read_ahead_bytes_{0};
+
+  void Close() noexcept;
+  std::shared_ptr<ReadAheadState> ReadAheadSnapshot() const;
+  static void ReadAhead(AVFormatContext* ctx, ReadAheadState* state) noexcept;
 };
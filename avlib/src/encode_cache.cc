@@ -0,0 +1,151 @@
+#include "encode_cache.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+static constexpr char kMagic[8] = {'A', 'V', 'L', 'E', 'N', 'C', '0', '1'};
+static constexpr int32_t kEnd = -1;
+
+struct RecordHeader {
+  int64_t pts;
+  int64_t dts;
+  int32_t flags;
+  int32_t size;
+};
+
+static std::size_t Align(std::size_t size) {
+  return (size + 7) & ~std::size_t{7};
+}
+
+EncodeCacheWriter::EncodeCacheWriter(std::string path, std::string_view key,
+                                     const FileStamp& source)
+    : path_{std::move(path)},
+      temp_{path_ + ".tmp"},
+      out_{temp_, std::ios::binary | std::ios::trunc} {
+  if (!out_) {
+    Throw("could not open ", temp_);
+  }
+  auto key_size = static_cast<uint32_t>(key.size());
+  out_.write(kMagic, sizeof(kMagic));
+  out_.write(reinterpret_cast<const char*>(&source.size), sizeof(source.size));
+  out_.write(reinterpret_cast<const char*>(&source.mtime),
+             sizeof(source.mtime));
+  out_.write(reinterpret_cast<const char*>(&key_size), sizeof(key_size));
+  out_.write(key.data(), key.size());
+  static const char zeros[8] = {};
+  auto header = sizeof(kMagic) + sizeof(FileStamp) + sizeof(key_size) +
+                key.size();
+  out_.write(zeros, Align(header) - header);
+}
+
+EncodeCacheWriter::~EncodeCacheWriter() noexcept {
+  if (!finished_) {
+    out_.close();
+    std::remove(temp_.c_str());
+  }
+}
+
+void EncodeCacheWriter::Append(const Packet& packet) {
+  static const char zeros[AV_INPUT_BUFFER_PADDING_SIZE + 8] = {};
+  RecordHeader record{packet->pts, packet->dts, packet->flags, packet->size};
+  out_.write(reinterpret_cast<const char*>(&record), sizeof(record));
+  out_.write(reinterpret_cast<const char*>(packet->data), packet->size);
+  auto padded = packet->size + AV_INPUT_BUFFER_PADDING_SIZE;
+  out_.write(zeros, Align(padded) - packet->size);
+  if (!out_) {
+    Throw("could not write ", temp_);
+  }
+}
+
+void EncodeCacheWriter::Finish() {
+  RecordHeader end{AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0, kEnd};
+  out_.write(reinterpret_cast<const char*>(&end), sizeof(end));
+  out_.close();
+  if (!out_) {
+    Throw("could not write ", temp_);
+  }
+  std::filesystem::rename(temp_, path_);
+  finished_ = true;
+}
+
+std::optional<EncodeCacheReader> EncodeCacheReader::Open(
+    std::string_view path, std::string_view key, const FileStamp& source) {
+  if (!std::filesystem::exists(std::string{path})) {
+    return std::nullopt;
+  }
+  auto file = std::make_shared<MappedFileSource>(path);
+  auto data = file->Data();
+  auto size = file->Size();
+  FileStamp stamp{};
+  uint32_t key_size = 0;
+  auto header = sizeof(kMagic) + sizeof(stamp) + sizeof(key_size);
+  if (size < header || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+    return std::nullopt;
+  }
+  std::memcpy(&stamp.size, data + sizeof(kMagic), sizeof(stamp.size));
+  std::memcpy(&stamp.mtime, data + sizeof(kMagic) + sizeof(stamp.size),
+              sizeof(stamp.mtime));
+  std::memcpy(&key_size, data + sizeof(kMagic) + sizeof(stamp),
+              sizeof(key_size));
+  if (!(stamp == source) || size < header + key_size ||
+      std::string_view{reinterpret_cast<const char*>(data + header),
+                       key_size} != key) {
+    return std::nullopt;
+  }
+  auto begin = Align(header + key_size);
+  // Walk the records once so that a truncated file is rejected up front.
+  for (auto position = begin;;) {
+    if (size < position + sizeof(RecordHeader)) {
+      return std::nullopt;
+    }
+    RecordHeader record{};
+    std::memcpy(&record, data + position, sizeof(record));
+    if (record.size == kEnd) {
+      break;
+    }
+    if (record.size < 0) {
+      return std::nullopt;
+    }
+    position += sizeof(record) +
+                Align(record.size + AV_INPUT_BUFFER_PADDING_SIZE);
+  }
+  return EncodeCacheReader{std::move(file), begin};
+}
+
+EncodeCacheReader::EncodeCacheReader(std::shared_ptr<MappedFileSource> file,
+                                     std::size_t begin)
+    : file_{std::move(file)}, begin_{begin}, position_{begin} {}
+
+std::optional<Packet> EncodeCacheReader::Next() {
+  RecordHeader record{};
+  std::memcpy(&record, file_->Data() + position_, sizeof(record));
+  if (record.size == kEnd) {
+    return std::nullopt;
+  }
+  auto payload = const_cast<uint8_t*>(file_->Data()) + position_ +
+                 sizeof(record);
+  position_ +=
+      sizeof(record) + Align(record.size + AV_INPUT_BUFFER_PADDING_SIZE);
+  Packet packet{};
+  packet.Unref();
+  packet->buf = av_buffer_create(
+      payload, record.size,
+      [](void* opaque, uint8_t*) {
+        delete static_cast<std::shared_ptr<MappedFileSource>*>(opaque);
+      },
+      new std::shared_ptr<MappedFileSource>{file_}, AV_BUFFER_FLAG_READONLY);
+  if (packet->buf == nullptr) {
+    Throw("could not wrap cached packet");
+  }
+  packet->data = payload;
+  packet->size = record.size;
+  packet->pts = record.pts;
+  packet->dts = record.dts;
+  packet->flags = record.flags;
+  return packet;
+}
+
+void EncodeCacheReader::Rewind() noexcept {
+  position_ = begin_;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "common.hh"
+#include "io_source.hh"
+#include "packet.hh"
+
+// On-disk cache of an encoded packet stream, keyed by the source file stamp
+// and a description of the encoder setup. The file holds a header and
+// 8-byte aligned records of pts, dts, flags and payload followed by zeroed
+// decoder padding, closed by an end record. It is written append-only to a
+// temporary file that is renamed once complete, and read back through a
+// memory mapping without copying payloads.
+class EncodeCacheWriter {
+ public:
+  explicit EncodeCacheWriter(std::string path, std::string_view key,
+                             const FileStamp& source);
+  EncodeCacheWriter(const EncodeCacheWriter& other) = delete;
+  EncodeCacheWriter& operator=(const EncodeCacheWriter& other) = delete;
+  // Removes the temporary file unless Finish was called.
+  ~EncodeCacheWriter() noexcept;
+
+  void Append(const Packet& packet);
+  void Finish();
+
+ private:
+  std::string path_;
+  std::string temp_;
+  std::ofstream out_;
+  bool finished_{false};
+};
+
+class EncodeCacheReader {
+ public:
+  // Returns std::nullopt if the cache is missing, incomplete or stale.
+  static std::optional<EncodeCacheReader> Open(std::string_view path,
+                                               std::string_view key,
+                                               const FileStamp& source);
+
+  // Packets reference the mapping, which stays alive while they do.
+  std::optional<Packet> Next();
+  void Rewind() noexcept;
+
+ private:
+  std::shared_ptr<MappedFileSource> file_;
+  std::size_t begin_{0};
+  std::size_t position_{0};
+
+  explicit EncodeCacheReader(std::shared_ptr<MappedFileSource> file,
+                             std::size_t begin);
+};
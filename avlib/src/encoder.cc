@@ -2,6 +2,9 @@
 
 #include <utility>
 
+#include "exclusive.hh"
+#include "profiler.hh"
+
 static const AVCodec* FindEncoderByName(std::string_view name) {
   auto codec = avcodec_find_encoder_by_name(name.data());
   if (codec == nullptr) {
@@ -23,7 +26,7 @@ Encoder::Encoder(const AVCodec* codec, const CodecConfig& config,
     CheckError(avcodec_parameters_to_context(ctx_, stream->codecpar));
   }
   config.Apply(ctx_);
-  CheckError(avcodec_open2(ctx_, codec, nullptr));
+  config.Open(ctx_, codec);
 }
 
 Encoder::Encoder(std::string_view codec, const CodecConfig& config,
@@ -49,16 +52,22 @@ void Encoder::SetOption(std::string_view name, std::string_view value,
 }
 
 void Encoder::Send(const Frame& frame) {
+  static auto& stage = Profiler::Stage("encoder.send");
+  ProfileScope scope{stage};
+  scope.Add(0, 1);
   CheckError(avcodec_send_frame(ctx_, *frame));
 }
 
 bool Encoder::Receive(Packet& packet) {
+  static auto& stage = Profiler::Stage("encoder.receive");
+  ProfileScope scope{stage};
   packet.MakeWritable();
   int ret = avcodec_receive_packet(ctx_, *packet);
   if (ret == AVERROR(EAGAIN) || ret == AVERROR(EOF)) {
     return false;
   }
   CheckError(ret);
+  scope.Add(packet->size);
   return true;
 }
 
@@ -128,19 +137,28 @@ Encoder::Iterator Encoder::end() noexcept {
 void Encoder::Register(py::module_& m) {
   auto c = py::class_<Encoder>(m, "Encoder");
 
-  c.def(py::init<std::string_view, const AVStream*>(), py::arg("codec_name"),
-        py::arg("stream") = py::none{});
-  c.def(py::init<std::string_view, const CodecConfig&, const AVStream*>(),
+  c.def(py::init([](std::string_view codec_name, const AVStream* stream) {
+          py::gil_scoped_release release{};
+          return std::make_unique<Encoder>(codec_name, stream);
+        }),
+        py::arg("codec_name"), py::arg("stream") = py::none{});
+  c.def(py::init([](std::string_view codec_name, const CodecConfig& config,
+                    const AVStream* stream) {
+          py::gil_scoped_release release{};
+          return std::make_unique<Encoder>(codec_name, config, stream);
+        }),
         py::arg("codec_name"), py::arg("config"),
         py::arg("stream") = py::none{});
 
   c.def("set_option", &Encoder::SetOption, py::arg("name"), py::arg("value"),
         py::arg("flags") = py::int_{0});
-  c.def("send", &Encoder::Send, py::arg("frame"));
-  c.def("receive", static_cast<bool (Encoder::*)(Packet&)>(&Encoder::Receive),
-        py::arg("packet"));
+  c.def("send", Exclusive(&Encoder::Send), py::arg("frame"));
   c.def("receive",
-        static_cast<std::optional<Packet> (Encoder::*)()>(&Encoder::Receive));
+        Exclusive(static_cast<bool (Encoder::*)(Packet&)>(&Encoder::Receive)),
+        py::arg("packet"));
+  c.def("receive", Exclusive(static_cast<std::optional<Packet> (Encoder::*)()>(
+                       &Encoder::Receive)));
+  c.def("flush", Exclusive(&Encoder::Flush));
 
   c.def(
       "__iter__",
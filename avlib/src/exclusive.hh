@@ -0,0 +1,62 @@
+#pragma once
+
+#include <mutex>
+#include <unordered_set>
+#include <utility>
+
+#include "common.hh"
+
+// Codec, scaler and demuxer objects are not thread-safe: one object must be
+// used by one thread at a time, while different objects may run in parallel.
+// Since their bindings release the GIL, an ExclusiveScope marks an object as
+// in use and makes a second concurrent call fail instead of corrupting the
+// underlying FFmpeg context.
+class ExclusiveScope {
+ public:
+  explicit ExclusiveScope(const void* object) : object_{object} {
+    std::lock_guard lock{Mutex()};
+    if (!Active().insert(object_).second) {
+      Throw("object is already in use by another thread");
+    }
+  }
+  ExclusiveScope(const ExclusiveScope& other) = delete;
+  ExclusiveScope& operator=(const ExclusiveScope& other) = delete;
+
+  ~ExclusiveScope() noexcept {
+    std::lock_guard lock{Mutex()};
+    Active().erase(object_);
+  }
+
+ private:
+  const void* object_;
+
+  static std::mutex& Mutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static std::unordered_set<const void*>& Active() {
+    static std::unordered_set<const void*> active;
+    return active;
+  }
+};
+
+// Binds a member function to run under an ExclusiveScope with the GIL
+// released. Only for methods whose arguments are native objects.
+template <typename Class, typename Ret, typename... Args>
+auto Exclusive(Ret (Class::*method)(Args...)) {
+  return [method](Class& self, Args... args) -> Ret {
+    ExclusiveScope scope{&self};
+    py::gil_scoped_release release{};
+    return (self.*method)(std::forward<Args>(args)...);
+  };
+}
+
+template <typename Class, typename Ret, typename... Args>
+auto Exclusive(Ret (Class::*method)(Args...) const) {
+  return [method](const Class& self, Args... args) -> Ret {
+    ExclusiveScope scope{&self};
+    py::gil_scoped_release release{};
+    return (self.*method)(std::forward<Args>(args)...);
+  };
+}
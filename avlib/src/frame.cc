@@ -1,5 +1,155 @@
 #include "frame.hh"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+#include "dlpack.hh"
+
+struct PlaneLayout {
+  ssize_t height{0};
+  ssize_t width{0};
+  ssize_t channels{1};
+  ssize_t bytes{1};
+  ssize_t step{0};
+  bool mixed{false};
+};
+
+// Derives the shape of every plane from the pixel format descriptor. Planes
+// which interleave components with different steps or subsampling (YUYV422
+// and friends) are exposed as rows of raw bytes; components packed across
+// byte boundaries (X2RGB10 and friends) as one element per pixel.
+static std::vector<PlaneLayout> PlaneLayouts(AVPixelFormat format, int width,
+                                             int height) {
+  auto desc = av_pix_fmt_desc_get(format);
+  if (desc == nullptr ||
+      desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM)) {
+    Throw("unsupported format");
+  }
+  if (desc->flags & AV_PIX_FMT_FLAG_PAL) {
+    return {{height, width, 1, 1, 1, false},
+            {1, 256, 4, 1, 4, false}};
+  }
+  std::vector<PlaneLayout> planes(av_pix_fmt_count_planes(format));
+  for (int i = 0; i < desc->nb_components; ++i) {
+    auto& comp = desc->comp[i];
+    auto& plane = planes[comp.plane];
+    auto chroma = !(desc->flags & AV_PIX_FMT_FLAG_RGB) && (i == 1 || i == 2);
+    auto w = chroma ? AV_CEIL_RSHIFT(width, desc->log2_chroma_w) : width;
+    auto h = chroma ? AV_CEIL_RSHIFT(height, desc->log2_chroma_h) : height;
+    if (plane.step && (plane.step != comp.step || plane.width != w)) {
+      plane.mixed = true;
+    }
+    plane.width = w;
+    plane.height = h;
+    plane.step = comp.step;
+    plane.bytes =
+        std::max<ssize_t>(plane.bytes, (comp.depth + comp.shift + 7) / 8);
+  }
+  for (auto& plane : planes) {
+    if (2 < plane.bytes) {
+      plane.bytes = 4;
+    }
+  }
+  for (int i = 0; i < desc->nb_components; ++i) {
+    auto& comp = desc->comp[i];
+    auto& plane = planes[comp.plane];
+    if (comp.offset % plane.bytes) {
+      plane.bytes = plane.step;
+    }
+  }
+  for (std::size_t i = 0; i < planes.size(); ++i) {
+    auto& plane = planes[i];
+    if (plane.mixed) {
+      plane.width = av_image_get_linesize(format, width, i);
+      plane.bytes = 1;
+    }
+    if (plane.mixed || plane.step % plane.bytes) {
+      plane.channels = 1;
+    } else {
+      plane.channels = plane.step / plane.bytes;
+    }
+    if (plane.bytes != 1 && plane.bytes != 2 && plane.bytes != 4) {
+      Throw("unsupported format");
+    }
+  }
+  return planes;
+}
+
+static std::vector<PlaneLayout> PlaneLayouts(const AVFrame* frame) {
+  return PlaneLayouts(static_cast<AVPixelFormat>(frame->format), frame->width,
+                      frame->height);
+}
+
+static bool IsBigEndian(const AVFrame* frame) {
+  auto desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+  return desc->flags & AV_PIX_FMT_FLAG_BE;
+}
+
+static std::pair<int, int> PlaneSize(const std::vector<py::array>& planes) {
+  if (planes.empty() || planes[0].ndim() < 2) {
+    Throw("expected at least one plane of two or more dimensions");
+  }
+  return {static_cast<int>(planes[0].shape(1)),
+          static_cast<int>(planes[0].shape(0))};
+}
+
+static void CheckPlanes(const std::vector<PlaneLayout>& layouts,
+                        const std::vector<py::array>& planes) {
+  if (layouts.size() != planes.size()) {
+    Throw("expected ", layouts.size(), " planes, got ", planes.size());
+  }
+  for (std::size_t i = 0; i < planes.size(); ++i) {
+    auto& array = planes[i];
+    auto& plane = layouts[i];
+    auto ndim = 1 < plane.channels ? 3 : 2;
+    if (array.ndim() != ndim || array.shape(0) != plane.height ||
+        array.shape(1) != plane.width ||
+        (ndim == 3 && array.shape(2) != plane.channels) ||
+        array.itemsize() != plane.bytes) {
+      Throw("plane ", i, " has unexpected shape or item size");
+    }
+    // Item size alone would accept float32 for 4-byte packed formats.
+    auto kind = array.dtype().kind();
+    if (kind != 'u' && kind != 'i') {
+      Throw("plane ", i, " must have an integer dtype, got '", kind, "'");
+    }
+  }
+}
+
+static bool IsRowContiguous(const py::array& array, const PlaneLayout& plane) {
+  return array.strides(1) == plane.channels * plane.bytes &&
+         (array.ndim() == 2 || array.strides(2) == plane.bytes);
+}
+
+static void CopyPlane(uint8_t* dst, int dst_stride, const py::array& src,
+                      const PlaneLayout& plane) {
+  auto data = static_cast<const uint8_t*>(src.data());
+  auto row = plane.width * plane.channels * plane.bytes;
+  if (IsRowContiguous(src, plane)) {
+    for (ssize_t y = 0; y < plane.height; ++y) {
+      std::memcpy(dst + y * dst_stride, data + y * src.strides(0), row);
+    }
+    return;
+  }
+  auto channel_stride = src.ndim() == 3 ? src.strides(2) : 0;
+  for (ssize_t y = 0; y < plane.height; ++y) {
+    auto d = dst + y * dst_stride;
+    auto s = data + y * src.strides(0);
+    for (ssize_t x = 0; x < plane.width; ++x) {
+      for (ssize_t c = 0; c < plane.channels; ++c) {
+        std::memcpy(d, s + x * src.strides(1) + c * channel_stride,
+                    plane.bytes);
+        d += plane.bytes;
+      }
+    }
+  }
+}
+
 Frame::Frame() : handle_{av_frame_alloc()} {}
 
 Frame::Frame(AVPixelFormat format, int width, int height) : Frame{} {
@@ -9,25 +159,16 @@ Frame::Frame(AVPixelFormat format, int width, int height) : Frame{} {
   CheckError(av_frame_get_buffer(handle_, 0));
 }
 
-Frame::Frame(AVPixelFormat format, const py::array_t<uint8_t>& data)
-    : Frame{format, data.shape(1), data.shape(0)} {
-  switch (format) {
-    case AV_PIX_FMT_RGBA:
-    case AV_PIX_FMT_ARGB:
-    case AV_PIX_FMT_BGRA:
-    case AV_PIX_FMT_ABGR:
-      for (std::size_t y = 0, rp = 0; y < data.shape(0); ++y) {
-        auto cp = rp;
-        for (std::size_t x = 0; x < data.shape(1); ++x) {
-          for (std::size_t z = 0; z < data.shape(2); ++z) {
-            handle_->data[0][cp++] = data.at(y, x, z);
-          }
-        }
-        rp += handle_->linesize[0];
-      }
-      break;
-    default:
-      Throw("unsupported format");
+Frame::Frame(AVPixelFormat format, const py::array& data)
+    : Frame{format, std::vector<py::array>{data}} {}
+
+// Copies pixels row by row, so any source strides are accepted.
+Frame::Frame(AVPixelFormat format, const std::vector<py::array>& planes)
+    : Frame{format, PlaneSize(planes).first, PlaneSize(planes).second} {
+  auto layouts = PlaneLayouts(handle_);
+  CheckPlanes(layouts, planes);
+  for (std::size_t i = 0; i < planes.size(); ++i) {
+    CopyPlane(handle_->data[i], handle_->linesize[i], planes[i], layouts[i]);
   }
 }
 
@@ -65,6 +206,21 @@ void Frame::MakeWritable() const noexcept {
   av_frame_make_writable(handle_);
 }
 
+Frame Frame::Crop(int left, int top, int width, int height) const {
+  if (left < 0 || top < 0 || width <= 0 || height <= 0 ||
+      handle_->width - width < left || handle_->height - height < top) {
+    Throw("region ", width, "x", height, "+", left, "+", top,
+          " exceeds the frame of ", handle_->width, "x", handle_->height);
+  }
+  Frame frame{*this};
+  frame->crop_left = left;
+  frame->crop_top = top;
+  frame->crop_right = handle_->width - left - width;
+  frame->crop_bottom = handle_->height - top - height;
+  CheckError(av_frame_apply_cropping(*frame, AV_FRAME_CROP_UNALIGNED));
+  return frame;
+}
+
 AVFrame* Frame::operator*() const noexcept {
   return handle_;
 }
@@ -73,6 +229,123 @@ AVFrame* Frame::operator->() const noexcept {
   return handle_;
 }
 
+// Wraps the arrays without copying. Each plane buffer keeps its array alive
+// and is read-only unless the array is writeable.
+Frame Frame::Wrap(AVPixelFormat format, const std::vector<py::array>& planes) {
+  auto [width, height] = PlaneSize(planes);
+  auto layouts = PlaneLayouts(format, width, height);
+  CheckPlanes(layouts, planes);
+  Frame frame{};
+  frame->format = format;
+  frame->width = width;
+  frame->height = height;
+  for (std::size_t i = 0; i < planes.size(); ++i) {
+    auto& array = planes[i];
+    auto& plane = layouts[i];
+    auto stride = array.strides(0);
+    if (!IsRowContiguous(array, plane) ||
+        stride < plane.width * plane.channels * plane.bytes ||
+        std::numeric_limits<int>::max() < stride) {
+      Throw("plane ", i, " must be row-contiguous to be wrapped");
+    }
+    auto data = static_cast<uint8_t*>(const_cast<void*>(array.data()));
+    auto owner = new py::object{array};
+    frame->buf[i] = av_buffer_create(
+        data, array.shape(0) * stride, &ReleasePyObject, owner,
+        array.writeable() ? 0 : AV_BUFFER_FLAG_READONLY);
+    if (frame->buf[i] == nullptr) {
+      delete owner;
+      Throw("could not wrap plane ", i);
+    }
+    frame->data[i] = data;
+    frame->linesize[i] = static_cast<int>(stride);
+  }
+  frame->extended_data = frame->data;
+  return frame;
+}
+
+// Returns views of the frame planes. Each array keeps a reference to the
+// frame buffers, so it stays valid after the frame is unreferenced.
+std::vector<py::array> Frame::Planes() const {
+  auto layouts = PlaneLayouts(handle_);
+  auto owner = av_frame_clone(handle_);
+  if (owner == nullptr) {
+    Throw("could not reference frame");
+  }
+  py::capsule base{owner, [](void* data) {
+                     auto frame = static_cast<AVFrame*>(data);
+                     av_frame_free(&frame);
+                   }};
+  auto order = IsBigEndian(handle_) ? ">" : "<";
+  std::vector<py::array> arrays{};
+  for (std::size_t i = 0; i < layouts.size(); ++i) {
+    auto& plane = layouts[i];
+    std::vector<ssize_t> shape{plane.height, plane.width};
+    std::vector<ssize_t> strides{owner->linesize[i],
+                                 plane.bytes * plane.channels};
+    if (1 < plane.channels) {
+      shape.push_back(plane.channels);
+      strides.push_back(plane.bytes);
+    }
+    py::dtype dtype{Format(order, "u", plane.bytes)};
+    arrays.emplace_back(dtype, shape, strides, owner->data[i], base);
+  }
+  return arrays;
+}
+
+// Exports single-plane frames through DLPack without copying. The managed
+// tensor holds a reference to the frame buffers until the consumer drops it.
+py::capsule Frame::ToDLPack() const {
+  struct Context {
+    DLManagedTensor tensor;
+    AVFrame* frame;
+    int64_t shape[3];
+    int64_t strides[3];
+  };
+
+  auto layouts = PlaneLayouts(handle_);
+  if (layouts.size() != 1) {
+    Throw("__dlpack__ supports single-plane formats only, use planes()");
+  }
+  if (IsBigEndian(handle_)) {
+    Throw("__dlpack__ does not support big-endian formats");
+  }
+  auto& plane = layouts[0];
+  auto ctx = new Context{};
+  ctx->frame = av_frame_clone(handle_);
+  if (ctx->frame == nullptr) {
+    delete ctx;
+    Throw("could not reference frame");
+  }
+  ctx->shape[0] = plane.height;
+  ctx->shape[1] = plane.width;
+  ctx->shape[2] = plane.channels;
+  ctx->strides[0] = ctx->frame->linesize[0] / plane.bytes;
+  ctx->strides[1] = plane.channels;
+  ctx->strides[2] = 1;
+  auto& tensor = ctx->tensor.dl_tensor;
+  tensor.data = ctx->frame->data[0];
+  tensor.device = {kDLCPU, 0};
+  tensor.ndim = 1 < plane.channels ? 3 : 2;
+  tensor.dtype = {kDLUInt, static_cast<uint8_t>(plane.bytes * 8), 1};
+  tensor.shape = ctx->shape;
+  tensor.strides = ctx->strides;
+  tensor.byte_offset = 0;
+  ctx->tensor.manager_ctx = ctx;
+  ctx->tensor.deleter = [](DLManagedTensor* self) {
+    auto ctx = static_cast<Context*>(self->manager_ctx);
+    av_frame_free(&ctx->frame);
+    delete ctx;
+  };
+  return py::capsule{&ctx->tensor, "dltensor", [](PyObject* capsule) {
+                       if (PyCapsule_IsValid(capsule, "dltensor")) {
+                         auto self = static_cast<DLManagedTensor*>(
+                             PyCapsule_GetPointer(capsule, "dltensor"));
+                         self->deleter(self);
+                       }
+                     }};
+}
+
 void Frame::Register(py::module_& m) {
   auto c = py::class_<Frame>(m, "Frame");
 
@@ -87,11 +360,30 @@ void Frame::Register(py::module_& m) {
   c.def(py::init<>([](AVPixelFormat format, std::pair<int, int> size) {
     return Frame{format, size.first, size.second};
   }));
-  c.def(py::init<AVPixelFormat, const py::array_t<uint8_t>&>());
+  c.def(py::init<AVPixelFormat, const py::array&>(), py::arg("format"),
+        py::arg("data"));
+  c.def(py::init([](AVPixelFormat format, const py::list& planes) {
+          return Frame{format, planes.cast<std::vector<py::array>>()};
+        }),
+        py::arg("format"), py::arg("planes"));
+  c.def_static(
+      "wrap",
+      [](AVPixelFormat format, const py::array& data) {
+        return Frame::Wrap(format, {data});
+      },
+      py::arg("format"), py::arg("data"));
+  c.def_static(
+      "wrap",
+      [](AVPixelFormat format, const py::list& planes) {
+        return Frame::Wrap(format, planes.cast<std::vector<py::array>>());
+      },
+      py::arg("format"), py::arg("planes"));
 
   c.def("set_flag", &Frame::SetFlag);
   c.def("unref", &Frame::Unref);
   c.def("make_writable", &Frame::MakeWritable);
+  c.def("crop", &Frame::Crop, py::arg("left"), py::arg("top"),
+        py::arg("width"), py::arg("height"));
   c.def_property_readonly("width",
                           [](const Frame& frame) { return frame->width; });
   c.def_property_readonly("height",
@@ -106,31 +398,10 @@ void Frame::Register(py::module_& m) {
       "pict_type", [](const Frame& frame) { return frame->pict_type; },
       [](const Frame& frame, AVPictureType v) { frame->pict_type = v; });
 
-  c.def("planes", [](const Frame& frame) {
-    std::vector<py::array_t<uint8_t>> arrays;
-    switch (static_cast<AVPixelFormat>(frame->format)) {
-      case AV_PIX_FMT_RGBA:
-      case AV_PIX_FMT_ARGB:
-      case AV_PIX_FMT_BGRA:
-      case AV_PIX_FMT_ABGR:
-        arrays.emplace_back(
-            std::vector<ssize_t>{frame->height, frame->width, 4},
-            std::vector<ssize_t>{frame->linesize[0], 4, 1}, frame->data[0]);
-        break;
-      case AV_PIX_FMT_YUV420P:
-        arrays.emplace_back(std::vector<ssize_t>{frame->height, frame->width},
-                            std::vector<ssize_t>{frame->linesize[0], 1},
-                            frame->data[0]);
-        arrays.emplace_back(
-            std::vector<ssize_t>{frame->height / 2, frame->width / 2},
-            std::vector<ssize_t>{frame->linesize[1], 1}, frame->data[1]);
-        arrays.emplace_back(
-            std::vector<ssize_t>{frame->height / 2, frame->width / 2},
-            std::vector<ssize_t>{frame->linesize[2], 1}, frame->data[2]);
-        break;
-      default:
-        Throw("unsupported format");
-    }
-    return arrays;
+  c.def("planes", &Frame::Planes);
+  c.def("__dlpack__", [](const Frame& frame, const py::args&,
+                         const py::kwargs&) { return frame.ToDLPack(); });
+  c.def("__dlpack_device__", [](const Frame&) {
+    return std::pair{static_cast<int>(kDLCPU), 0};
   });
 }
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <vector>
+
 #include "common.hh"
+#include "profiler.hh"
 
 class Frame {
  public:
@@ -14,7 +17,8 @@ class Frame {
 
   explicit Frame();
   explicit Frame(AVPixelFormat format, int width, int height);
-  explicit Frame(AVPixelFormat format, const py::array_t<uint8_t>& data);
+  explicit Frame(AVPixelFormat format, const py::array& data);
+  explicit Frame(AVPixelFormat format, const std::vector<py::array>& planes);
   Frame(const Frame& other);
   Frame(Frame&& other) noexcept;
   Frame& operator=(const Frame& other);
@@ -24,12 +28,18 @@ class Frame {
   void SetFlag(Flag flag) noexcept;
   void Unref() const noexcept;
   void MakeWritable() const noexcept;
+  // Returns a new reference to the region of this frame without copying.
+  Frame Crop(int left, int top, int width, int height) const;
+  std::vector<py::array> Planes() const;
+  py::capsule ToDLPack() const;
 
   AVFrame* operator*() const noexcept;
   AVFrame* operator->() const noexcept;
 
+  static Frame Wrap(AVPixelFormat format, const std::vector<py::array>& planes);
   static void Register(py::module_& m);
 
  private:
   AVFrame* handle_{nullptr};
+  LiveCount live_{Profiler::live_frames};
 };
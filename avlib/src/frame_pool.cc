@@ -0,0 +1,140 @@
+#include "frame_pool.hh"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+FramePool::FramePool(int align) : align_{align} {
+  if (align <= 0 || align & (align - 1)) {
+    Throw("pool alignment must be a power of two, got ", align);
+  }
+}
+
+FramePool::~FramePool() noexcept {
+  Clear();
+}
+
+void FramePool::Get(AVFrame* frame, int width, int height) {
+  auto format = static_cast<AVPixelFormat>(frame->format);
+  std::lock_guard lock{mutex_};
+  auto& planes = Find(format, width, height);
+  allocated_ = false;
+  for (std::size_t i = 0; i < planes.pools.size() && planes.pools[i]; ++i) {
+    frame->buf[i] = av_buffer_pool_get(planes.pools[i]);
+    if (frame->buf[i] == nullptr) {
+      av_frame_unref(frame);
+      Throw("could not get pooled buffer");
+    }
+    // Buffers carry `align_` bytes of slack to align the plane start in.
+    auto data = reinterpret_cast<uintptr_t>(frame->buf[i]->data);
+    frame->data[i] = reinterpret_cast<uint8_t*>(FFALIGN(data, align_));
+    frame->linesize[i] = planes.linesize[i];
+  }
+  frame->extended_data = frame->data;
+  ++(allocated_ ? misses_ : hits_);
+}
+
+void FramePool::Get(AVFrame* frame) {
+  Get(frame, frame->width, frame->height);
+}
+
+Frame FramePool::Allocate(AVPixelFormat format, int width, int height) {
+  Frame frame{};
+  frame->format = format;
+  frame->width = width;
+  frame->height = height;
+  Get(*frame);
+  return frame;
+}
+
+void FramePool::Clear() noexcept {
+  std::lock_guard lock{mutex_};
+  for (auto& [key, planes] : planes_) {
+    for (auto& pool : planes.pools) {
+      av_buffer_pool_uninit(&pool);
+    }
+  }
+  planes_.clear();
+}
+
+uint64_t FramePool::Requests() const noexcept {
+  return hits_ + misses_;
+}
+
+uint64_t FramePool::Hits() const noexcept {
+  return hits_;
+}
+
+uint64_t FramePool::Misses() const noexcept {
+  return misses_;
+}
+
+int FramePool::GetBuffer(AVCodecContext* ctx, AVFrame* frame, int flags) {
+  auto pool = static_cast<FramePool*>(ctx->opaque);
+  auto desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+  if (pool == nullptr || ctx->codec_type != AVMEDIA_TYPE_VIDEO ||
+      ctx->hw_frames_ctx || !(ctx->codec->capabilities & AV_CODEC_CAP_DR1) ||
+      desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+    return avcodec_default_get_buffer2(ctx, frame, flags);
+  }
+  int width = frame->width;
+  int height = frame->height;
+  int linesize_align[AV_NUM_DATA_POINTERS];
+  avcodec_align_dimensions2(ctx, &width, &height, linesize_align);
+  try {
+    pool->Get(frame, width, height);
+  } catch (...) {
+    return AVERROR(ENOMEM);
+  }
+  return 0;
+}
+
+std::shared_ptr<FramePool> FramePool::Shared() {
+  static auto pool = std::make_shared<FramePool>();
+  return pool;
+}
+
+FramePool::Planes& FramePool::Find(AVPixelFormat format, int width,
+                                   int height) {
+  auto [it, inserted] = planes_.try_emplace({format, width, height});
+  auto& planes = it->second;
+  if (!inserted) {
+    return planes;
+  }
+  int linesize[4];
+  auto ret = av_image_fill_linesizes(linesize, format, width);
+  if (ret < 0) {
+    planes_.erase(it);
+    CheckError(ret);
+  }
+  ptrdiff_t aligned[4];
+  for (std::size_t i = 0; i < 4; ++i) {
+    planes.linesize[i] = FFALIGN(linesize[i], align_);
+    aligned[i] = planes.linesize[i];
+  }
+  size_t sizes[4];
+  ret = av_image_fill_plane_sizes(sizes, format, height, aligned);
+  if (ret < 0) {
+    planes_.erase(it);
+    CheckError(ret);
+  }
+  for (std::size_t i = 0; i < 4 && sizes[i]; ++i) {
+    planes.pools[i] = av_buffer_pool_init2(sizes[i] + align_, this,
+                                           &FramePool::Alloc, nullptr);
+  }
+  return planes;
+}
+
+AVBufferRef* FramePool::Alloc(void* opaque, size_t size) {
+  static_cast<FramePool*>(opaque)->allocated_ = true;
+  return av_buffer_alloc(size);
+}
+
+void FramePool::Register(py::module_& m) {
+  auto c = py::class_<FramePool, std::shared_ptr<FramePool>>(m, "FramePool");
+  c.def_static("shared", &FramePool::Shared);
+  c.def("clear", &FramePool::Clear);
+  c.def_property_readonly("requests", &FramePool::Requests);
+  c.def_property_readonly("hits", &FramePool::Hits);
+  c.def_property_readonly("misses", &FramePool::Misses);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+#include "common.hh"
+#include "frame.hh"
+
+// Hands out frame buffers from AVBufferPools keyed by format and size, so
+// that recycled frames skip malloc, zeroing and page faults. Plane pointers
+// and linesizes are aligned to `align`, a power of two. Thread-safe.
+class FramePool {
+ public:
+  explicit FramePool(int align = 64);
+  FramePool(const FramePool& other) = delete;
+  FramePool& operator=(const FramePool& other) = delete;
+  ~FramePool() noexcept;
+
+  // Attaches pooled buffers for `frame` format, large enough for a picture of
+  // `width` x `height`, which may be padded past the frame size.
+  void Get(AVFrame* frame, int width, int height);
+  void Get(AVFrame* frame);
+  Frame Allocate(AVPixelFormat format, int width, int height);
+  void Clear() noexcept;
+
+  // Calls of Get, counted as misses if any plane had to be allocated.
+  uint64_t Requests() const noexcept;
+  uint64_t Hits() const noexcept;
+  uint64_t Misses() const noexcept;
+
+  // get_buffer2 callback; expects the pool in AVCodecContext::opaque.
+  static int GetBuffer(AVCodecContext* ctx, AVFrame* frame, int flags);
+  static std::shared_ptr<FramePool> Shared();
+  static void Register(py::module_& m);
+
+ private:
+  struct Planes {
+    std::array<AVBufferPool*, 4> pools{};
+    std::array<int, 4> linesize{};
+  };
+
+  std::mutex mutex_;
+  std::map<std::tuple<int, int, int>, Planes> planes_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  // Set by Alloc during the current Get, guarded by `mutex_`.
+  bool allocated_{false};
+  int align_;
+
+  Planes& Find(AVPixelFormat format, int width, int height);
+  static AVBufferRef* Alloc(void* opaque, size_t size);
+};
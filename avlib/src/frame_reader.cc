@@ -0,0 +1,183 @@
+#include "frame_reader.hh"
+
+#include <algorithm>
+
+#include "exclusive.hh"
+
+static int64_t Timestamp(const Frame& frame) {
+  return frame->best_effort_timestamp != AV_NOPTS_VALUE
+             ? frame->best_effort_timestamp
+             : frame->pts;
+}
+
+FrameReader::FrameReader(std::string_view filename, std::size_t cache_size,
+                         const std::optional<std::string>& decoder,
+                         bool sidecar)
+    : cache_size_{std::max<std::size_t>(cache_size, 1)} {
+  demuxer_.emplace(filename);
+  stream_ = demuxer_->FindBestStream(AVMEDIA_TYPE_VIDEO);
+  if (stream_ == nullptr) {
+    Throw("could not find video stream in ", filename);
+  }
+  demuxer_->SelectStreams({stream_->index});
+  if (decoder) {
+    decoder_.emplace(*decoder, stream_);
+  } else {
+    auto codec = avcodec_find_decoder(stream_->codecpar->codec_id);
+    if (codec == nullptr) {
+      Throw("could not find decoder for ", filename);
+    }
+    decoder_.emplace(codec, stream_);
+  }
+  index_ = KeyframeIndex::LoadOrBuild(filename, sidecar);
+  if (index_.StreamIndex() != stream_->index) {
+    index_ = KeyframeIndex::Build(*demuxer_, stream_);
+  }
+  if (index_.Keyframes().empty()) {
+    Throw("no keyframes in ", filename);
+  }
+  frame_rate_ = stream_->avg_frame_rate.num ? stream_->avg_frame_rate
+                                            : stream_->r_frame_rate;
+  start_ = stream_->start_time != AV_NOPTS_VALUE ? stream_->start_time
+                                                 : index_.Keyframes().front();
+}
+
+Frame FrameReader::ReadAt(int64_t timestamp) {
+  auto keyframe = index_.Find(timestamp);
+  if (!keyframe) {
+    Throw("timestamp ", timestamp, " is before the first keyframe");
+  }
+  auto& gop = Load(*keyframe);
+  auto it = std::upper_bound(
+      gop.begin(), gop.end(), timestamp,
+      [](int64_t ts, const Frame& frame) { return ts < Timestamp(frame); });
+  if (it == gop.begin()) {
+    Throw("could not decode frame at ", timestamp);
+  }
+  return *std::prev(it);
+}
+
+Frame FrameReader::ReadFrame(int64_t index) {
+  if (frame_rate_.num <= 0 || frame_rate_.den <= 0) {
+    Throw("stream has no frame rate");
+  }
+  if (index < 0) {
+    Throw("invalid frame index ", index);
+  }
+  // Aim at the middle of the frame so rounding does not select its
+  // predecessor.
+  auto duration = av_inv_q(frame_rate_);
+  return ReadAt(start_ +
+                av_rescale_q(2 * index + 1, duration, stream_->time_base) / 2);
+}
+
+int64_t FrameReader::FrameCount() const noexcept {
+  if (0 < stream_->nb_frames) {
+    return stream_->nb_frames;
+  }
+  if (stream_->duration == AV_NOPTS_VALUE || frame_rate_.num <= 0) {
+    return -1;
+  }
+  return av_rescale_q(stream_->duration, stream_->time_base,
+                      av_inv_q(frame_rate_));
+}
+
+void FrameReader::Clear() noexcept {
+  lookup_.clear();
+  cache_.clear();
+}
+
+const KeyframeIndex& FrameReader::Index() const noexcept {
+  return index_;
+}
+
+const AVStream* FrameReader::Stream() const noexcept {
+  return stream_;
+}
+
+const FrameReader::Gop& FrameReader::Load(int64_t keyframe) {
+  if (auto it = lookup_.find(keyframe); it != lookup_.end()) {
+    ++hits_;
+    cache_.splice(cache_.begin(), cache_, it->second);
+    return it->second->second;
+  }
+  ++misses_;
+  auto gop = DecodeGop(keyframe);
+  if (cache_size_ <= cache_.size()) {
+    lookup_.erase(cache_.back().first);
+    cache_.pop_back();
+  }
+  cache_.emplace_front(keyframe, std::move(gop));
+  lookup_[keyframe] = cache_.begin();
+  return cache_.front().second;
+}
+
+// Decodes the frames displayed from `keyframe` up to the next keyframe.
+// In an open GOP, the frames displayed just before the next keyframe follow
+// it in decode order, so decoding continues past that keyframe until the
+// decoder outputs a frame at or after it. Leading frames displayed before
+// `keyframe` belong to the previous GOP and are dropped.
+FrameReader::Gop FrameReader::DecodeGop(int64_t keyframe) {
+  demuxer_->Seek(stream_, keyframe);
+  decoder_->Reset();
+  auto next = index_.Next(keyframe);
+  auto after = [&](const Frame& frame) { return *next <= Timestamp(frame); };
+  Gop frames{};
+  Packet packet{};
+  bool reached = false;
+  while (demuxer_->Read(packet, stream_)) {
+    if (next && (packet->flags & AV_PKT_FLAG_KEY)) {
+      auto ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+      reached = reached || *next <= ts;
+    }
+    auto decoded = frames.size();
+    decoder_->Decode(frames, packet);
+    packet.Unref();
+    if (reached &&
+        std::any_of(frames.begin() + decoded, frames.end(), after)) {
+      break;
+    }
+  }
+  decoder_->Flush();
+  for (auto frame = decoder_->Receive(); frame; frame = decoder_->Receive()) {
+    frames.push_back(std::move(*frame));
+  }
+  decoder_->Reset();
+  frames.erase(std::remove_if(frames.begin(), frames.end(),
+                              [&](const Frame& frame) {
+                                return Timestamp(frame) < keyframe ||
+                                       (next && after(frame));
+                              }),
+               frames.end());
+  std::stable_sort(frames.begin(), frames.end(),
+                   [](const Frame& a, const Frame& b) {
+                     return Timestamp(a) < Timestamp(b);
+                   });
+  return frames;
+}
+
+void FrameReader::Register(py::module_& m) {
+  auto c = py::class_<FrameReader>(m, "FrameReader");
+
+  c.def(py::init([](std::string_view filename, std::size_t cache_size,
+                    const std::optional<std::string>& decoder, bool sidecar) {
+          py::gil_scoped_release release{};
+          return std::make_unique<FrameReader>(filename, cache_size, decoder,
+                                               sidecar);
+        }),
+        py::arg("filename"), py::arg("cache_size") = 4,
+        py::arg("decoder") = py::none{}, py::arg("sidecar") = true);
+
+  c.def("read_at", Exclusive(&FrameReader::ReadAt), py::arg("timestamp"));
+  c.def("read_frame", Exclusive(&FrameReader::ReadFrame), py::arg("index"));
+  c.def("clear", Exclusive(&FrameReader::Clear));
+  c.def("__getitem__", Exclusive(&FrameReader::ReadFrame), py::arg("index"));
+  c.def_property_readonly("frame_count", &FrameReader::FrameCount);
+  c.def_property_readonly("index", &FrameReader::Index,
+                          py::return_value_policy::reference_internal);
+  c.def_property_readonly("stream", &FrameReader::Stream,
+                          py::return_value_policy::reference_internal);
+  c.def_property_readonly("hits", [](const FrameReader& r) { return r.hits_; });
+  c.def_property_readonly("misses",
+                          [](const FrameReader& r) { return r.misses_; });
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common.hh"
+#include "decoder.hh"
+#include "demuxer.hh"
+#include "frame.hh"
+#include "keyframe_index.hh"
+
+// Random access to decoded frames. Seeks to the keyframe at or before the
+// requested timestamp and decodes forward to the next keyframe; the decoded
+// GOPs are kept in an LRU cache so nearby accesses do not decode again.
+class FrameReader {
+ public:
+  explicit FrameReader(std::string_view filename, std::size_t cache_size = 4,
+                       const std::optional<std::string>& decoder = {},
+                       bool sidecar = true);
+  FrameReader(const FrameReader& other) = delete;
+  FrameReader& operator=(const FrameReader& other) = delete;
+
+  // Returns the frame displayed at `timestamp` (stream time base).
+  Frame ReadAt(int64_t timestamp);
+  // Returns frame `index`, assuming a constant frame rate.
+  Frame ReadFrame(int64_t index);
+  int64_t FrameCount() const noexcept;
+  void Clear() noexcept;
+
+  const KeyframeIndex& Index() const noexcept;
+  const AVStream* Stream() const noexcept;
+
+  static void Register(py::module_& m);
+
+ private:
+  using Gop = std::vector<Frame>;
+  using Entry = std::pair<int64_t, Gop>;
+
+  std::optional<Demuxer> demuxer_;
+  const AVStream* stream_;
+  std::optional<Decoder> decoder_;
+  KeyframeIndex index_;
+  AVRational frame_rate_;
+  int64_t start_;
+  std::list<Entry> cache_;
+  std::map<int64_t, std::list<Entry>::iterator> lookup_;
+  std::size_t cache_size_;
+  std::size_t hits_{0};
+  std::size_t misses_{0};
+
+  const Gop& Load(int64_t keyframe);
+  Gop DecodeGop(int64_t keyframe);
+};
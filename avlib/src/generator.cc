@@ -1,16 +1,58 @@
 #include "generator.hh"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <limits>
+
+#include "exclusive.hh"
+#include "profiler.hh"
+
+static void ConfigureEncoder(Encoder& encoder, std::string_view name) {
+  if (name.find("nvenc") != std::string_view::npos) {
+    encoder.SetOption("zerolatency", "1");
+    encoder.SetOption("delay", "0");
+    encoder.SetOption("forced-idr", "1");
+  } else if (name == "libx264") {
+    encoder.SetOption("tune", "zerolatency");
+    encoder.SetOption("forced-idr", "1");
+  }
+}
+
+// Engines for different purposes get unrelated streams from one seed.
+static std::default_random_engine Engine(std::optional<unsigned> seed,
+                                         unsigned purpose) {
+  std::seed_seq sequence{seed ? *seed : std::random_device{}(), purpose};
+  return std::default_random_engine{sequence};
+}
 
 Generator::Generator(std::string_view filename, int width, int height,
-                     int batch_size)
+                     const GeneratorOptions& options)
     : filename_{filename},
-      random_{5, 50},
-      batch_size_{batch_size},
+      options_{options},
+      random_{5, 50, options.seed},
+      damage_random_{Engine(options.seed, 1)},
+      augment_random_{Engine(options.seed, 2)},
       width_{width},
       height_{height} {
+  if (options.crop &&
+      (options.crop->first <= 0 || width < options.crop->first ||
+       options.crop->second <= 0 || height < options.crop->second)) {
+    Throw("crop ", options.crop->first, "x", options.crop->second,
+          " does not fit frames of ", width, "x", height);
+  }
+  auto [sample_width, sample_height] = options.SampleSize(width, height);
+  if (sample_width <= 0 || sample_height <= 0) {
+    Throw("invalid output size ", sample_width, "x", sample_height);
+  }
   file_converter_.emplace(AV_PIX_FMT_YUV420P, width, height);
-  rgba_converter_.emplace(AV_PIX_FMT_RGBA, width, height);
+  x_converter_.emplace(options.layout, options.dtype, sample_width,
+                       sample_height, options.scale);
+  y_converter_.emplace(options.layout, options.dtype, sample_width,
+                       sample_height, options.scale);
+  ring_ = std::make_shared<BufferRing>(
+      options.batch_size * x_converter_->SampleSize(), options.ring);
   config_.bitrate = 5'000'000;
   config_.width = width;
   config_.height = height;
@@ -22,71 +64,246 @@ Generator::Generator(std::string_view filename, int width, int height,
   config_.max_b_frames = 0;
   config_.refs = 1;
   config_.SetFlag(CodecConfig::Flag::LOW_DELAY);
+  if (1 < options.variants) {
+    pool_ = std::make_unique<ThreadPool>(options.variants);
+  }
   Reset();
 }
 
+Generator::~Generator() noexcept {
+  StopPrefetch();
+}
+
 void Generator::Reset() {
-  file_demuxer_.emplace(filename_);
-  stream_ = file_demuxer_->FindBestStream(AVMEDIA_TYPE_VIDEO);
-  file_decoder_.emplace("h264_cuvid", stream_);
-  encoder_.emplace("h264_nvenc", config_);
-  encoder_->SetOption("zerolatency", "1");
-  encoder_->SetOption("delay", "0");
-  decoder_.emplace("h264_cuvid", config_);
-  x_frames_.clear();
+  StopPrefetch();
+  cache_writer_.reset();
+  cache_reader_.reset();
+  pending_.reset();
+  clean_decoder_.reset();
+  if (options_.cache) {
+    auto source = StampFile(filename_);
+    auto key = CacheKey();
+    cache_reader_ = EncodeCacheReader::Open(*options_.cache, key, source);
+    if (!cache_reader_) {
+      cache_writer_.emplace(*options_.cache, key, source);
+    }
+    clean_decoder_.emplace(options_.decoder, config_);
+  }
+  if (cache_reader_) {
+    file_demuxer_.reset();
+    file_decoder_.reset();
+    encoder_.reset();
+  } else {
+    OpenSource();
+  }
+  variants_.clear();
+  for (int k = 0; k < std::max(options_.variants, 1); ++k) {
+    variants_.push_back(
+        Variant{Decoder{options_.decoder, config_}, {}, {}, {}});
+  }
+  variant_ = 0;
   y_frames_.clear();
   pts_ = 0;
+  if (0 < options_.prefetch) {
+    StartPrefetch();
+  }
+}
+
+void Generator::OpenSource() {
+  file_demuxer_.emplace(filename_);
+  stream_ = file_demuxer_->FindBestStream(AVMEDIA_TYPE_VIDEO);
+  if (stream_ == nullptr) {
+    Throw("could not find video stream in ", filename_);
+  }
+  file_demuxer_->SelectStreams({stream_->index});
+  if (options_.start) {
+    file_demuxer_->Seek(stream_, *options_.start);
+  }
+  if (0 < options_.read_ahead) {
+    file_demuxer_->StartReadAhead(options_.read_ahead);
+  }
+  file_decoder_.emplace(options_.decoder, stream_);
+  encoder_.emplace(options_.encoder, config_);
+  ConfigureEncoder(*encoder_, options_.encoder);
+}
+
+void Generator::StartPrefetch() {
+  error_ = nullptr;
+  queue_.emplace(options_.prefetch);
+  worker_ = std::thread{&Generator::Prefetch, this};
+}
+
+void Generator::StopPrefetch() noexcept {
+  if (queue_) {
+    queue_->Close();
+  }
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+  queue_.reset();
 }
 
-Generator::Batch Generator::GenerateBatch() {
-  auto stride = width_ * 4;
-  auto x_buffer = std::make_unique<uint8_t[]>(batch_size_ * height_ * stride);
-  auto y_buffer = std::make_unique<uint8_t[]>(batch_size_ * height_ * stride);
-  std::size_t p = 0;
-  for (int i = 0; i < batch_size_; ++i) {
-    auto pair = GeneratePair();
-    if (!pair) {
-      return {std::nullopt, std::nullopt};
+void Generator::Prefetch() noexcept {
+  try {
+    for (auto batch = NextBatch(); batch; batch = NextBatch()) {
+      if (!queue_->Push(std::move(*batch))) {
+        return;
+      }
     }
-    auto [x, y] = *pair;
-    std::size_t q = 0;
-    std::size_t r = 0;
-    for (int j = 0; j < height_; ++j) {
-      std::memcpy(&x_buffer[p], &x->data[0][q], stride);
-      std::memcpy(&y_buffer[p], &y->data[0][r], stride);
-      p += stride;
-      q += x->linesize[0];
-      r += y->linesize[0];
+  } catch (...) {
+    error_ = std::current_exception();
+  }
+  queue_->Close();
+}
+
+Generator::Batch Generator::GenerateBatch(std::vector<int32_t>* distances) {
+  std::optional<NativeBatch> batch;
+  if (queue_) {
+    batch = PopBatch();
+  } else {
+    py::gil_scoped_release release{};
+    batch = NextBatch();
+  }
+  if (!batch) {
+    return {std::nullopt, std::nullopt};
+  }
+  if (distances) {
+    *distances = std::move(batch->distances);
+  }
+  return {x_converter_->Wrap(std::move(batch->x), options_.batch_size, ring_),
+          y_converter_->Wrap(std::move(batch->y), options_.batch_size, ring_)};
+}
+
+bool Generator::GenerateBatchInto(const py::buffer& x_out,
+                                  const py::buffer& y_out,
+                                  int32_t* distances) {
+  auto x_info = x_converter_->Request(x_out, options_.batch_size);
+  auto y_info = y_converter_->Request(y_out, options_.batch_size);
+  auto x = static_cast<uint8_t*>(x_info.ptr);
+  auto y = static_cast<uint8_t*>(y_info.ptr);
+  auto size = SampleSize();
+  if (queue_) {
+    auto batch = PopBatch();
+    if (!batch) {
+      return false;
+    }
+    py::gil_scoped_release release{};
+    static auto& stage = Profiler::Stage("generator.batch_copy");
+    ProfileScope scope{stage};
+    scope.Add(2 * options_.batch_size * size, 2 * options_.batch_size);
+    std::memcpy(x, batch->x.get(), options_.batch_size * size);
+    std::memcpy(y, batch->y.get(), options_.batch_size * size);
+    if (distances) {
+      std::copy(batch->distances.begin(), batch->distances.end(), distances);
+    }
+    ring_->Release(std::move(batch->x));
+    ring_->Release(std::move(batch->y));
+    return true;
+  }
+  py::gil_scoped_release release{};
+  for (int i = 0; i < options_.batch_size; ++i) {
+    if (!GenerateSample(x + i * size, y + i * size,
+                        distances ? distances + i : nullptr)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::optional<Generator::NativeBatch> Generator::NextBatch() {
+  auto size = SampleSize();
+  auto x_buffer = ring_->Acquire();
+  auto y_buffer = ring_->Acquire();
+  std::vector<int32_t> distances(options_.batch_size);
+  for (int i = 0; i < options_.batch_size; ++i) {
+    if (!GenerateSample(&x_buffer[i * size], &y_buffer[i * size],
+                        &distances[i])) {
+      return std::nullopt;
     }
   }
+  return NativeBatch{std::move(x_buffer), std::move(y_buffer),
+                     std::move(distances)};
+}
 
-  auto x_ptr = x_buffer.release();
-  py::capsule x_capsule{
-      x_ptr, [](void* data) { delete[] static_cast<uint8_t*>(data); }};
-  py::array_t<uint8_t> x_array{{batch_size_, height_, width_, 4},
-                               {height_ * width_ * 4, width_ * 4, 4, 1},
-                               x_ptr,
-                               x_capsule};
+std::optional<Generator::NativeBatch> Generator::PopBatch() {
+  std::optional<NativeBatch> batch;
+  {
+    py::gil_scoped_release release{};
+    batch = queue_->Pop();
+  }
+  if (!batch && error_) {
+    std::rethrow_exception(error_);
+  }
+  return batch;
+}
 
-  auto y_ptr = y_buffer.release();
-  py::capsule y_capsule{
-      y_ptr, [](void* data) { delete[] static_cast<uint8_t*>(data); }};
-  py::array_t<uint8_t> y_array{{batch_size_, height_, width_, 4},
-                               {height_ * width_ * 4, width_ * 4, 4, 1},
-                               y_ptr,
-                               y_capsule};
+bool Generator::GenerateSample(uint8_t* x, uint8_t* y, int32_t* distance) {
+  auto pair = GeneratePair();
+  if (!pair) {
+    return false;
+  }
+  static auto& stage = Profiler::Stage("generator.sample_convert");
+  ProfileScope scope{stage};
+  scope.Add(2 * SampleSize(), 2);
+  auto flip =
+      options_.flip && std::bernoulli_distribution{0.5}(augment_random_);
+  if (options_.crop) {
+    // Even offsets keep the chroma planes of YUV 4:2:0 frames aligned.
+    auto [w, h] = *options_.crop;
+    auto left = 2 * std::uniform_int_distribution<int>{
+                        0, (width_ - w) / 2}(augment_random_);
+    auto top = 2 * std::uniform_int_distribution<int>{
+                       0, (height_ - h) / 2}(augment_random_);
+    x_converter_->Convert(pair->x.Crop(left, top, w, h), x, flip);
+    y_converter_->Convert(pair->y.Crop(left, top, w, h), y, flip);
+  } else {
+    x_converter_->Convert(pair->x, x, flip);
+    y_converter_->Convert(pair->y, y, flip);
+  }
+  if (distance) {
+    *distance = pair->distance;
+  }
+  return true;
+}
 
-  return {x_array, y_array};
+std::size_t Generator::SampleSize() const noexcept {
+  return x_converter_->SampleSize();
 }
 
-bool Generator::GenerateGroup() {
-  std::vector<Packet> packets{};
+bool Generator::Prefetching() const noexcept {
+  return queue_.has_value();
+}
+
+std::optional<Packet> Generator::ReadSource() {
+  auto packet = file_demuxer_->Read(stream_);
+  if (packet && options_.end && ((*packet)->flags & AV_PKT_FLAG_KEY)) {
+    auto ts = (*packet)->pts != AV_NOPTS_VALUE ? (*packet)->pts
+                                               : (*packet)->dts;
+    if (*options_.end <= ts) {
+      return std::nullopt;
+    }
+  }
+  return packet;
+}
+
+std::string Generator::CacheKey() const {
+  return Format(options_.decoder, ';', options_.encoder, ';', width_, 'x',
+                height_, ';', options_.start.value_or(-1), ';',
+                options_.end.value_or(-1), ';',
+                options_.seed ? std::to_string(*options_.seed) : "none", ';',
+                config_.Describe());
+}
+
+// Encodes one group of random size starting with a forced keyframe.
+bool Generator::EncodeGroup(std::vector<Packet>& packets) {
+  static auto& source_decode = Profiler::Stage("generator.source_decode");
+  static auto& source_convert = Profiler::Stage("generator.source_convert");
+  static auto& encode = Profiler::Stage("generator.encode");
   auto n = random_();
-  auto p = std::max<std::size_t>(1, n / 5);
   bool has_key = false;
   bool first = true;
   for (bool more = true; more;) {
-    auto packet = encoder_->Receive();
+    auto packet = Profiled(encode, [&] { return encoder_->Receive(); });
     if (packet.has_value()) {
       if (has_key || (*packet)->flags & AV_PKT_FLAG_KEY) {
         packets.push_back(std::move(*packet));
@@ -95,78 +312,322 @@ bool Generator::GenerateGroup() {
     } else if (n <= packets.size()) {
       more = false;
     } else {
-      auto frame = file_decoder_->Receive();
+      auto frame =
+          Profiled(source_decode, [&] { return file_decoder_->Receive(); });
       if (frame.has_value()) {
-        auto f = file_converter_->Convert(*frame);
+        auto f = Profiled(source_convert,
+                          [&] { return file_converter_->Convert(*frame); });
         f->pts = pts_++;
         if (first) {
           first = false;
           f->pict_type = AV_PICTURE_TYPE_I;
-          encoder_->SetOption("forced-idr", "1");
         } else {
           f->pict_type = AV_PICTURE_TYPE_P;
         }
-        encoder_->Send(f);
-        y_frames_.push_back(std::move(f));
+        Profiled(encode, [&] { encoder_->Send(f); });
+        if (!clean_decoder_) {
+          y_frames_.push_back(std::move(f));
+        }
       } else {
-        auto file_packet = file_demuxer_->Read(stream_);
+        auto file_packet = ReadSource();
         if (file_packet.has_value()) {
-          file_decoder_->Send(*file_packet);
+          Profiled(source_decode, [&] { file_decoder_->Send(*file_packet); });
         } else {
           return false;
         }
       }
     }
   }
-  n = packets.size();
-  for (std::size_t i = 0; i < n; ++i) {
-    if ((i < (n - p - 2)) || ((n - 2) <= i)) {
-      decoder_->Decode(x_frames_, packets[i]);
+  return true;
+}
+
+// Replays one recorded group: a keyframe and the packets up to the next one.
+bool Generator::ReadCachedGroup(std::vector<Packet>& packets) {
+  if (!pending_) {
+    pending_ = cache_reader_->Next();
+  }
+  if (!pending_) {
+    return false;
+  }
+  packets.push_back(std::move(*pending_));
+  pending_.reset();
+  for (auto packet = cache_reader_->Next(); packet;
+       packet = cache_reader_->Next()) {
+    if ((*packet)->flags & AV_PKT_FLAG_KEY) {
+      pending_ = std::move(packet);
+      break;
     }
+    packets.push_back(std::move(*packet));
   }
   return true;
 }
 
-std::optional<std::pair<Frame, Frame>> Generator::GeneratePair() {
-  std::optional<std::size_t> x_i;
-  std::optional<std::size_t> y_i;
-  while (!x_i) {
-    if (!GenerateGroup()) {
-      return std::nullopt;
+bool Generator::GenerateGroup() {
+  std::vector<Packet> packets{};
+  if (!(cache_reader_ ? ReadCachedGroup(packets) : EncodeGroup(packets))) {
+    if (cache_writer_) {
+      cache_writer_->Finish();
+      cache_writer_.reset();
     }
-    for (std::size_t i = 1; i < x_frames_.size(); ++i) {
-      if (x_frames_[i - 1]->pts + 1 < x_frames_[i]->pts) {
-        x_i = i;
-        break;
+    return false;
+  }
+  if (cache_writer_) {
+    for (auto& packet : packets) {
+      cache_writer_->Append(packet);
+    }
+  }
+  if (clean_decoder_) {
+    static auto& clean_decode = Profiler::Stage("generator.clean_decode");
+    auto frames =
+        Profiled(clean_decode, [&] { return clean_decoder_->Decode(packets); });
+    std::move(frames.begin(), frames.end(), std::back_inserter(y_frames_));
+  }
+  auto n = packets.size();
+  // Replayed groups keep their sizes, so the patterns are rotated by a
+  // random offset to vary the damage between epochs.
+  std::size_t offset = 0;
+  if (cache_reader_) {
+    offset = std::uniform_int_distribution<std::size_t>{0, 2}(damage_random_);
+  }
+  std::vector<std::vector<bool>> drops{};
+  for (std::size_t k = 0; k < variants_.size(); ++k) {
+    drops.push_back(DropPattern(k + offset, n));
+  }
+  static auto& damaged_decode = Profiler::Stage("generator.damaged_decode");
+  auto decode = [&](std::size_t k, std::size_t) {
+    ProfileScope scope{damaged_decode};
+    auto& variant = variants_[k];
+    std::vector<Frame> decoded{};
+    for (std::size_t i = 0; i < n; ++i) {
+      if (!drops[k][i]) {
+        variant.decoder.Decode(decoded, packets[i]);
       }
     }
+    scope.Add(0, decoded.size());
+    std::move(decoded.begin(), decoded.end(),
+              std::back_inserter(variant.frames));
+  };
+  if (pool_) {
+    pool_->ParallelFor(variants_.size(), decode);
+  } else {
+    decode(0, 0);
   }
-  for (std::size_t i = 0; i < y_frames_.size(); ++i) {
-    if (y_frames_[i]->pts == x_frames_[*x_i]->pts) {
-      y_i = i;
+  Trim();
+  return true;
+}
+
+// Packets of a group of `n` to drop for a variant. The keyframe and the
+// last packet are always kept.
+std::vector<bool> Generator::DropPattern(std::size_t variant, std::size_t n) {
+  std::vector<bool> drop(n, false);
+  if (n < 3) {
+    return drop;
+  }
+  std::size_t begin = 0;
+  std::size_t length = 0;
+  switch (variant % 3) {
+    case 0:
+      length = std::max<std::size_t>(1, n / 5);
+      begin = n < length + 3 ? 1 : n - length - 2;
+      break;
+    case 1:
+      length = std::uniform_int_distribution<std::size_t>{
+          1, std::max<std::size_t>(1, n / 5)}(damage_random_);
+      length = std::min(length, n - 2);
+      begin = std::uniform_int_distribution<std::size_t>{1, n - length - 1}(
+          damage_random_);
       break;
+    default:
+      length = 1;
+      begin = std::uniform_int_distribution<std::size_t>{1, n - 2}(
+          damage_random_);
+      break;
+  }
+  std::fill_n(drop.begin() + begin, std::min(length, n - 1 - begin), true);
+  return drop;
+}
+
+// Follows the damage state along the x frames in decode order: a pts gap
+// starts a loss, a keyframe heals it.
+void Generator::Track(Variant& variant, const Frame& x) {
+  if (x->flags & AV_FRAME_FLAG_KEY) {
+    variant.loss.reset();
+  } else if (variant.last_pts && *variant.last_pts + 1 < x->pts) {
+    variant.loss = x->pts;
+  }
+  variant.last_pts = x->pts;
+}
+
+// Drops the oldest frames beyond the cap. x frames without a y frame left
+// are dropped as well, so every remaining x frame still finds its y frame.
+void Generator::Trim() {
+  auto cap = options_.max_buffered;
+  if (cap == 0) {
+    return;
+  }
+  while (cap < y_frames_.size()) {
+    y_frames_.pop_front();
+  }
+  for (auto& variant : variants_) {
+    auto& frames = variant.frames;
+    while (cap < frames.size() ||
+           (!frames.empty() && !y_frames_.empty() &&
+            frames.front()->pts < y_frames_.front()->pts)) {
+      Track(variant, frames.front());
+      frames.pop_front();
+    }
+  }
+}
+
+// Drops the y frames that no variant can pair anymore.
+void Generator::PruneY() {
+  auto needed = std::numeric_limits<int64_t>::max();
+  for (auto& variant : variants_) {
+    if (!variant.frames.empty()) {
+      needed = std::min(needed, variant.frames.front()->pts);
+    } else if (variant.last_pts) {
+      needed = std::min(needed, *variant.last_pts + 1);
+    } else {
+      return;
+    }
+  }
+  while (!y_frames_.empty() && y_frames_.front()->pts < needed) {
+    y_frames_.pop_front();
+  }
+}
+
+std::optional<Generator::Pair> Generator::TakePair(Variant& variant) {
+  while (!variant.frames.empty()) {
+    auto x = std::move(variant.frames.front());
+    variant.frames.pop_front();
+    Track(variant, x);
+    auto pts = x->pts;
+    auto loss = variant.loss;
+    if (!loss || (!options_.all_damaged && *loss != pts)) {
+      continue;
     }
+    auto y = std::lower_bound(
+        y_frames_.begin(), y_frames_.end(), pts,
+        [](const Frame& frame, int64_t pts) { return frame->pts < pts; });
+    if (y == y_frames_.end() || (*y)->pts != pts) {
+      Throw("could not find proper y frame");
+    }
+    Pair pair{std::move(x), *y, static_cast<int32_t>(pts - *loss)};
+    PruneY();
+    return pair;
   }
-  if (!x_i || !y_i) {
-    Throw("could not find proper y frame");
+  return std::nullopt;
+}
+
+// Takes pairs from the variants in turn and decodes another group once all
+// of them ran dry.
+std::optional<Generator::Pair> Generator::GeneratePair() {
+  for (;;) {
+    for (std::size_t tried = 0; tried < variants_.size(); ++tried) {
+      auto& variant = variants_[variant_];
+      variant_ = (variant_ + 1) % variants_.size();
+      if (auto pair = TakePair(variant)) {
+        return pair;
+      }
+    }
+    PruneY();
+    if (!GenerateGroup()) {
+      return std::nullopt;
+    }
   }
-  auto x = rgba_converter_->Convert(x_frames_[*x_i]);
-  auto y = rgba_converter_->Convert(y_frames_[*y_i]);
-  x_frames_.erase(x_frames_.begin(), x_frames_.begin() + *x_i + 1);
-  y_frames_.erase(y_frames_.begin(), y_frames_.begin() + *y_i + 1);
-  return std::pair{std::move(x), std::move(y)};
 }
 
 void Generator::Register(py::module_& m) {
   auto c = py::class_<Generator>(m, "Generator");
 
   c.def(py::init([](std::string_view filename, std::pair<int, int> size,
-                    int batch_size) {
-          return Generator{filename, size.first, size.second, batch_size};
+                    int batch_size, int prefetch, int read_ahead, int ring,
+                    Layout layout, DType dtype, std::string_view decoder,
+                    std::string_view encoder, std::optional<unsigned> seed,
+                    std::optional<std::string> cache, bool all_damaged,
+                    bool distances, std::size_t max_buffered, int variants,
+                    std::optional<std::pair<int, int>> crop,
+                    std::optional<std::pair<int, int>> output_size,
+                    bool flip) {
+          GeneratorOptions options{};
+          options.batch_size = batch_size;
+          options.prefetch = prefetch;
+          options.read_ahead = read_ahead;
+          options.ring = ring;
+          options.layout = layout;
+          options.dtype = dtype;
+          options.decoder = decoder;
+          options.encoder = encoder;
+          options.seed = seed;
+          options.cache = std::move(cache);
+          options.all_damaged = all_damaged;
+          options.distances = distances;
+          options.max_buffered = max_buffered;
+          options.variants = variants;
+          options.crop = crop;
+          options.output_size = output_size;
+          options.flip = flip;
+          py::gil_scoped_release release{};
+          return std::make_unique<Generator>(filename, size.first, size.second,
+                                             options);
         }),
         py::arg("filename"), py::arg("frame_size") = std::pair{1280, 720},
-        py::arg("batch_size") = 32);
+        py::arg("batch_size") = 32, py::arg("prefetch") = 0,
+        py::arg("read_ahead") = 0, py::arg("ring") = 0,
+        py::arg("layout") = Layout::RGBA, py::arg("dtype") = DType::UINT8,
+        py::arg("decoder") = "h264_cuvid", py::arg("encoder") = "h264_nvenc",
+        py::arg("seed") = py::none{}, py::arg("cache") = py::none{},
+        py::arg("all_damaged") = false, py::arg("distances") = false,
+        py::arg("max_buffered") = 256, py::arg("variants") = 1,
+        py::arg("crop") = py::none{}, py::arg("output_size") = py::none{},
+        py::arg("flip") = false);
 
-  c.def("reset", &Generator::Reset);
-  c.def("generate_batch", &Generator::GenerateBatch);
+  c.def("reset", Exclusive(&Generator::Reset));
+  c.def("generate_batch", [](Generator& g) -> py::object {
+    ExclusiveScope scope{&g};
+    if (!g.options_.distances) {
+      return py::cast(g.GenerateBatch());
+    }
+    std::vector<int32_t> distances;
+    auto [x, y] = g.GenerateBatch(&distances);
+    if (!x) {
+      return py::make_tuple(py::none{}, py::none{}, py::none{});
+    }
+    return py::make_tuple(std::move(*x), std::move(*y),
+                          py::array_t<int32_t>(distances.size(),
+                                               distances.data()));
+  });
+  c.def(
+      "generate_batch_into",
+      [](Generator& g, const py::buffer& x_out, const py::buffer& y_out,
+         const std::optional<py::buffer>& distances_out) {
+        ExclusiveScope scope{&g};
+        // Held until the batch is written, like the x and y buffers.
+        std::optional<py::buffer_info> info;
+        int32_t* distances = nullptr;
+        if (distances_out) {
+          info = distances_out->request(true);
+          auto stride = info->itemsize;
+          for (auto i = info->ndim - 1; 0 <= i; --i) {
+            if (info->shape[i] != 1 && info->strides[i] != stride) {
+              Throw("distances buffer must be C-contiguous");
+            }
+            stride *= info->shape[i];
+          }
+          if (info->itemsize != sizeof(int32_t) ||
+              info->size < g.options_.batch_size) {
+            Throw("distances buffer must hold ", g.options_.batch_size,
+                  " int32 values");
+          }
+          distances = static_cast<int32_t*>(info->ptr);
+        }
+        return g.GenerateBatchInto(x_out, y_out, distances);
+      },
+      py::arg("x_out"), py::arg("y_out"),
+      py::arg("distances_out") = py::none{});
+  c.def_property_readonly(
+      "prefetch", [](const Generator& g) { return g.options_.prefetch; });
+  c.def_property_readonly("queued", [](const Generator& g) {
+    return g.queue_ ? g.queue_->Size() : std::size_t{0};
+  });
 }
@@ -1,45 +1,167 @@
 #pragma once
 
+#include <deque>
+#include <exception>
+#include <memory>
 #include <optional>
 #include <random>
+#include <string>
+#include <thread>
 #include <tuple>
 
 #include "converter.hh"
 #include "decoder.hh"
 #include "demuxer.hh"
+#include "buffer_ring.hh"
+#include "encode_cache.hh"
 #include "encoder.hh"
+#include "layout_converter.hh"
+#include "queue.hh"
+#include "thread_pool.hh"
+
+struct GeneratorOptions {
+  std::string decoder{"h264_cuvid"};
+  std::string encoder{"h264_nvenc"};
+  std::optional<unsigned> seed;
+  // Segment of the source in stream time base. Both bounds must be keyframe
+  // timestamps; reading stops at the first keyframe at or after `end`.
+  std::optional<int64_t> start;
+  std::optional<int64_t> end;
+  Layout layout{Layout::RGBA};
+  // Scaling of the output conversion. Unless `output_size` rescales the
+  // frames, only chroma is interpolated.
+  ScaleOptions scale{ScaleAlgorithm::FAST_BILINEAR};
+  // Random patch cut from the same place of x and y, and the size it is
+  // then scaled to, both converted straight into the batch. The frame size
+  // is used for either if not set.
+  std::optional<std::pair<int, int>> crop;
+  std::optional<std::pair<int, int>> output_size;
+  // Mirror a random half of the samples horizontally.
+  bool flip{false};
+  DType dtype{DType::UINT8};
+  int batch_size{32};
+  int prefetch{0};
+  // Packets demuxed ahead of the decoder on a separate thread.
+  int read_ahead{0};
+  // Number of released batch buffers kept for reuse.
+  int ring{0};
+  // Cache file of the clean encoder output. The first epoch records its
+  // groups; later epochs replay them and skip the source decode, conversion
+  // and encode. With a cache, y frames are decoded from the clean packets.
+  // Replayed epochs keep the recorded group sizes; the drop pattern of each
+  // variant is instead rotated at random per group.
+  std::optional<std::string> cache;
+  // Emit every damaged frame from the loss up to the next keyframe instead of
+  // only the first frame after the loss.
+  bool all_damaged{false};
+  // Return the distance of each sample from its loss, zero for the first
+  // frame decoded after it, as a third int32 array.
+  bool distances{false};
+  // Cap on the decoded frames buffered per side, dropping the oldest beyond
+  // it. Should exceed the largest group; zero disables the cap.
+  std::size_t max_buffered{256};
+  // Damaged decodes of every encoded group, run in parallel. Variant k drops
+  // packets by pattern k % 3: the burst before the last two packets, a burst
+  // of random position and length, or a single random reference frame.
+  // Patterns are rotated at random when replaying a cache.
+  int variants{1};
+
+  // Size of the samples generated from frames of `width` x `height`.
+  std::pair<int, int> SampleSize(int width, int height) const {
+    return output_size.value_or(crop.value_or(std::pair{width, height}));
+  }
+};
 
 class Generator {
  public:
-  using Batch = std::pair<std::optional<py::array_t<uint8_t>>,
-                          std::optional<py::array_t<uint8_t>>>;
+  using Batch = std::pair<std::optional<py::array>, std::optional<py::array>>;
 
   explicit Generator(std::string_view filename, int width, int height,
-                     int batch_size = 32);
+                     const GeneratorOptions& options = {});
+  Generator(const Generator& other) = delete;
+  Generator& operator=(const Generator& other) = delete;
+  ~Generator() noexcept;
 
   void Reset();
-  Batch GenerateBatch();
+  // `distances`, if given, receives the distance label of every sample.
+  Batch GenerateBatch(std::vector<int32_t>* distances = nullptr);
+  bool GenerateBatchInto(const py::buffer& x_out, const py::buffer& y_out,
+                         int32_t* distances = nullptr);
+  bool GenerateSample(uint8_t* x, uint8_t* y, int32_t* distance = nullptr);
+  std::size_t SampleSize() const noexcept;
+  // Whether batches are generated on a separate thread, in which case
+  // GenerateSample must not be called.
+  bool Prefetching() const noexcept;
 
   static void Register(py::module_& m);
 
  private:
+  struct NativeBatch {
+    std::unique_ptr<uint8_t[]> x;
+    std::unique_ptr<uint8_t[]> y;
+    std::vector<int32_t> distances;
+  };
+
+  struct Pair {
+    Frame x;
+    Frame y;
+    int32_t distance;
+  };
+
+  // A damaged decoder and its x frames. `last_pts` is the timestamp of the
+  // last x frame taken and `loss` that of the first damaged frame since the
+  // last loss, if not yet healed by a keyframe.
+  struct Variant {
+    Decoder decoder;
+    std::deque<Frame> frames;
+    std::optional<int64_t> last_pts;
+    std::optional<int64_t> loss;
+  };
+
   std::string filename_;
+  GeneratorOptions options_;
   Random<std::size_t> random_;
+  std::default_random_engine damage_random_;
+  std::default_random_engine augment_random_;
   CodecConfig config_;
   std::optional<Converter> file_converter_;
-  std::optional<Converter> rgba_converter_;
+  std::optional<LayoutConverter> x_converter_;
+  std::optional<LayoutConverter> y_converter_;
+  std::shared_ptr<BufferRing> ring_;
   std::optional<Demuxer> file_demuxer_;
   std::optional<Decoder> file_decoder_;
   std::optional<Encoder> encoder_;
-  std::optional<Decoder> decoder_;
-  std::vector<Frame> x_frames_;
-  std::vector<Frame> y_frames_;
+  std::optional<Decoder> clean_decoder_;
+  std::optional<EncodeCacheWriter> cache_writer_;
+  std::optional<EncodeCacheReader> cache_reader_;
+  std::optional<Packet> pending_;
+  std::vector<Variant> variants_;
+  std::size_t variant_{0};
+  std::unique_ptr<ThreadPool> pool_;
+  std::deque<Frame> y_frames_;
   const AVStream* stream_;
   int64_t pts_;
-  int batch_size_;
   int width_;
   int height_;
+  std::optional<BoundedQueue<NativeBatch>> queue_;
+  std::thread worker_;
+  std::exception_ptr error_;
 
+  void OpenSource();
+  void StartPrefetch();
+  void StopPrefetch() noexcept;
+  void Prefetch() noexcept;
+  std::optional<NativeBatch> NextBatch();
+  std::optional<NativeBatch> PopBatch();
+  std::optional<Packet> ReadSource();
+  std::string CacheKey() const;
+  bool EncodeGroup(std::vector<Packet>& packets);
+  bool ReadCachedGroup(std::vector<Packet>& packets);
   bool GenerateGroup();
-  std::optional<std::pair<Frame, Frame>> GeneratePair();
+  std::vector<bool> DropPattern(std::size_t variant, std::size_t n);
+  static void Track(Variant& variant, const Frame& x);
+  void Trim();
+  void PruneY();
+  std::optional<Pair> TakePair(Variant& variant);
+  std::optional<Pair> GeneratePair();
 };
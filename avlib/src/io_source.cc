@@ -0,0 +1,182 @@
+#include "io_source.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+bool IOSource::Seekable() const noexcept {
+  return true;
+}
+
+int IOSource::ReadPacket(void* opaque, uint8_t* buffer, int size) {
+  return static_cast<IOSource*>(opaque)->Read(buffer, size);
+}
+
+int64_t IOSource::SeekPacket(void* opaque, int64_t offset, int whence) {
+  return static_cast<IOSource*>(opaque)->Seek(offset, whence);
+}
+
+MemorySource::MemorySource(const uint8_t* data, std::size_t size)
+    : data_{data}, size_{size} {}
+
+int MemorySource::Read(uint8_t* buffer, int size) {
+  if (size_ <= position_) {
+    return AVERROR_EOF;
+  }
+  auto n = std::min<std::size_t>(size, size_ - position_);
+  std::memcpy(buffer, data_ + position_, n);
+  position_ += n;
+  return static_cast<int>(n);
+}
+
+int64_t MemorySource::Seek(int64_t offset, int whence) {
+  int64_t position = 0;
+  switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+      return size_;
+    case SEEK_SET:
+      position = offset;
+      break;
+    case SEEK_CUR:
+      position = position_ + offset;
+      break;
+    case SEEK_END:
+      position = size_ + offset;
+      break;
+    default:
+      return AVERROR(EINVAL);
+  }
+  if (position < 0) {
+    return AVERROR(EINVAL);
+  }
+  position_ = position;
+  return position;
+}
+
+BufferSource::BufferSource(const py::buffer& buffer)
+    : info_{std::make_unique<py::buffer_info>(buffer.request())} {
+  auto size = info_->itemsize;
+  for (auto i = info_->ndim - 1; 0 <= i; --i) {
+    if (info_->shape[i] != 1 && info_->strides[i] != size) {
+      Throw("buffer must be C-contiguous");
+    }
+    size *= info_->shape[i];
+  }
+  data_ = static_cast<const uint8_t*>(info_->ptr);
+  size_ = size;
+}
+
+BufferSource::~BufferSource() {
+  py::gil_scoped_acquire acquire{};
+  info_.reset();
+}
+
+const uint8_t* MemorySource::Data() const noexcept {
+  return data_;
+}
+
+std::size_t MemorySource::Size() const noexcept {
+  return size_;
+}
+
+MappedFileSource::MappedFileSource(std::string_view filename) {
+  std::string name{filename};
+  auto fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    Throw("could not open ", filename, ": ", std::strerror(errno));
+  }
+  struct stat st {};
+  if (fstat(fd, &st) < 0) {
+    auto error = errno;
+    close(fd);
+    Throw("could not stat ", filename, ": ", std::strerror(error));
+  }
+  size_ = st.st_size;
+  if (0 < size_) {
+    mapping_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  auto error = errno;
+  close(fd);
+  if (mapping_ == MAP_FAILED) {
+    mapping_ = nullptr;
+    Throw("could not map ", filename, ": ", std::strerror(error));
+  }
+  if (mapping_) {
+    madvise(mapping_, size_, MADV_SEQUENTIAL);
+  }
+  data_ = static_cast<const uint8_t*>(mapping_);
+}
+
+MappedFileSource::~MappedFileSource() {
+  if (mapping_) {
+    munmap(mapping_, size_);
+  }
+}
+
+PythonSource::PythonSource(py::object file)
+    : file_{std::make_unique<py::object>(std::move(file))},
+      readinto_{py::hasattr(*file_, "readinto")},
+      seekable_{py::hasattr(*file_, "seek")} {
+  if (!readinto_ && !py::hasattr(*file_, "read")) {
+    Throw("file object has neither read() nor readinto()");
+  }
+  if (seekable_ && py::hasattr(*file_, "seekable")) {
+    seekable_ = (*file_).attr("seekable")().cast<bool>();
+  }
+}
+
+PythonSource::~PythonSource() {
+  py::gil_scoped_acquire acquire{};
+  file_.reset();
+}
+
+int PythonSource::Read(uint8_t* buffer, int size) {
+  py::gil_scoped_acquire acquire{};
+  try {
+    std::size_t n = 0;
+    if (readinto_) {
+      auto view = py::memoryview::from_memory(buffer, size);
+      auto ret = file_->attr("readinto")(view);
+      n = ret.is_none() ? 0 : ret.cast<std::size_t>();
+    } else {
+      auto data = file_->attr("read")(size).cast<py::bytes>();
+      auto bytes = std::string_view{data};
+      n = std::min<std::size_t>(bytes.size(), size);
+      std::memcpy(buffer, bytes.data(), n);
+    }
+    return 0 < n ? static_cast<int>(n) : AVERROR_EOF;
+  } catch (py::error_already_set& e) {
+    e.discard_as_unraisable(__func__);
+    return AVERROR(EIO);
+  }
+}
+
+int64_t PythonSource::Seek(int64_t offset, int whence) {
+  if (!seekable_) {
+    return AVERROR(ENOSYS);
+  }
+  py::gil_scoped_acquire acquire{};
+  try {
+    auto seek = file_->attr("seek");
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE) {
+      auto position = file_->attr("tell")();
+      auto size = seek(0, SEEK_END).cast<int64_t>();
+      seek(position, SEEK_SET);
+      return size;
+    }
+    return seek(offset, whence).cast<int64_t>();
+  } catch (py::error_already_set& e) {
+    e.discard_as_unraisable(__func__);
+    return AVERROR(EIO);
+  }
+}
+
+bool PythonSource::Seekable() const noexcept {
+  return seekable_;
+}
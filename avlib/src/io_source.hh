@@ -0,0 +1,76 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "common.hh"
+
+// Byte source behind a custom AVIOContext.
+class IOSource {
+ public:
+  virtual ~IOSource() = default;
+
+  // Returns the number of bytes read, AVERROR_EOF or another AVERROR code.
+  virtual int Read(uint8_t* buffer, int size) = 0;
+  // Follows the avio seek callback contract, including AVSEEK_SIZE.
+  virtual int64_t Seek(int64_t offset, int whence) = 0;
+  virtual bool Seekable() const noexcept;
+
+  static int ReadPacket(void* opaque, uint8_t* buffer, int size);
+  static int64_t SeekPacket(void* opaque, int64_t offset, int whence);
+};
+
+class MemorySource : public IOSource {
+ public:
+  explicit MemorySource(const uint8_t* data, std::size_t size);
+
+  int Read(uint8_t* buffer, int size) override;
+  int64_t Seek(int64_t offset, int whence) override;
+  const uint8_t* Data() const noexcept;
+  std::size_t Size() const noexcept;
+
+ protected:
+  MemorySource() = default;
+  const uint8_t* data_{nullptr};
+  std::size_t size_{0};
+  std::size_t position_{0};
+};
+
+// Reads from a Python object exporting the buffer protocol without copying
+// it; the exporter is pinned for the lifetime of the source.
+class BufferSource : public MemorySource {
+ public:
+  explicit BufferSource(const py::buffer& buffer);
+  ~BufferSource() override;
+
+ private:
+  std::unique_ptr<py::buffer_info> info_;
+};
+
+// Reads from a read-only memory mapping of a file, so data reaches the
+// demuxer without read() system calls.
+class MappedFileSource : public MemorySource {
+ public:
+  explicit MappedFileSource(std::string_view filename);
+  ~MappedFileSource() override;
+
+ private:
+  void* mapping_{nullptr};
+};
+
+// Reads from any Python object with read() or readinto() and optionally
+// seek(). The GIL is taken only inside the callbacks.
+class PythonSource : public IOSource {
+ public:
+  explicit PythonSource(py::object file);
+  ~PythonSource() override;
+
+  int Read(uint8_t* buffer, int size) override;
+  int64_t Seek(int64_t offset, int whence) override;
+  bool Seekable() const noexcept override;
+
+ private:
+  std::unique_ptr<py::object> file_;
+  bool readinto_;
+  bool seekable_;
+};
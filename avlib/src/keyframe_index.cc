@@ -0,0 +1,144 @@
+#include "keyframe_index.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+static constexpr char kMagic[8] = {'A', 'V', 'L', 'K', 'F', 'I', '0', '1'};
+
+template <typename Tp>
+static void WriteValue(std::ostream& out, const Tp& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename Tp>
+static bool ReadValue(std::istream& in, Tp& value) {
+  return static_cast<bool>(
+      in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+KeyframeIndex::KeyframeIndex(std::vector<int64_t> keyframes, int stream_index)
+    : keyframes_{std::move(keyframes)}, stream_index_{stream_index} {
+  std::sort(keyframes_.begin(), keyframes_.end());
+  keyframes_.erase(std::unique(keyframes_.begin(), keyframes_.end()),
+                   keyframes_.end());
+}
+
+KeyframeIndex KeyframeIndex::Build(Demuxer& demuxer, const AVStream* stream) {
+  if (stream == nullptr) {
+    Throw("could not find video stream");
+  }
+  return KeyframeIndex{demuxer.ScanKeyframes(stream), stream->index};
+}
+
+std::optional<KeyframeIndex> KeyframeIndex::Load(std::string_view filename) {
+  std::ifstream in{SidecarPath(filename), std::ios::binary};
+  if (!in) {
+    return std::nullopt;
+  }
+  char magic[sizeof(kMagic)];
+  FileStamp stamp{};
+  int32_t stream_index = 0;
+  uint64_t count = 0;
+  if (!in.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+      !ReadValue(in, stamp.size) || !ReadValue(in, stamp.mtime) ||
+      !ReadValue(in, stream_index) || !ReadValue(in, count)) {
+    return std::nullopt;
+  }
+  auto source = StampFile(filename);
+  if (!(stamp == source)) {
+    return std::nullopt;
+  }
+  std::vector<int64_t> keyframes(count);
+  if (!in.read(reinterpret_cast<char*>(keyframes.data()),
+               count * sizeof(int64_t))) {
+    return std::nullopt;
+  }
+  return KeyframeIndex{std::move(keyframes), stream_index};
+}
+
+KeyframeIndex KeyframeIndex::LoadOrBuild(std::string_view filename,
+                                         bool sidecar) {
+  if (sidecar) {
+    if (auto index = Load(filename)) {
+      return std::move(*index);
+    }
+  }
+  Demuxer demuxer{filename};
+  auto stream = demuxer.FindBestStream(AVMEDIA_TYPE_VIDEO);
+  if (stream != nullptr) {
+    demuxer.SelectStreams({stream->index});
+  }
+  auto index = Build(demuxer, stream);
+  if (sidecar) {
+    try {
+      index.Save(filename);
+    } catch (const std::exception&) {
+      // The sidecar is only a cache; a read-only location is not an error.
+    }
+  }
+  return index;
+}
+
+void KeyframeIndex::Save(std::string_view filename) const {
+  auto path = SidecarPath(filename);
+  auto temp = path + ".tmp";
+  auto stamp = StampFile(filename);
+  {
+    std::ofstream out{temp, std::ios::binary | std::ios::trunc};
+    out.write(kMagic, sizeof(kMagic));
+    WriteValue(out, stamp.size);
+    WriteValue(out, stamp.mtime);
+    WriteValue(out, static_cast<int32_t>(stream_index_));
+    WriteValue(out, static_cast<uint64_t>(keyframes_.size()));
+    out.write(reinterpret_cast<const char*>(keyframes_.data()),
+              keyframes_.size() * sizeof(int64_t));
+    if (!out) {
+      Throw("could not write ", temp);
+    }
+  }
+  std::filesystem::rename(temp, path);
+}
+
+std::optional<int64_t> KeyframeIndex::Find(int64_t timestamp) const {
+  auto it = std::upper_bound(keyframes_.begin(), keyframes_.end(), timestamp);
+  if (it == keyframes_.begin()) {
+    return std::nullopt;
+  }
+  return *std::prev(it);
+}
+
+std::optional<int64_t> KeyframeIndex::Next(int64_t keyframe) const {
+  auto it = std::upper_bound(keyframes_.begin(), keyframes_.end(), keyframe);
+  if (it == keyframes_.end()) {
+    return std::nullopt;
+  }
+  return *it;
+}
+
+const std::vector<int64_t>& KeyframeIndex::Keyframes() const noexcept {
+  return keyframes_;
+}
+
+int KeyframeIndex::StreamIndex() const noexcept {
+  return stream_index_;
+}
+
+std::string KeyframeIndex::SidecarPath(std::string_view filename) {
+  return Format(filename, ".kfi");
+}
+
+void KeyframeIndex::Register(py::module_& m) {
+  auto c = py::class_<KeyframeIndex>(m, "KeyframeIndex");
+
+  c.def_static("load_or_build", &KeyframeIndex::LoadOrBuild,
+               py::arg("filename"), py::arg("sidecar") = true,
+               py::call_guard<py::gil_scoped_release>());
+  c.def("find", &KeyframeIndex::Find, py::arg("timestamp"));
+  c.def("next", &KeyframeIndex::Next, py::arg("keyframe"));
+  c.def_property_readonly("keyframes", &KeyframeIndex::Keyframes);
+  c.def_property_readonly("stream_index", &KeyframeIndex::StreamIndex);
+  c.def("__len__",
+        [](const KeyframeIndex& index) { return index.Keyframes().size(); });
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common.hh"
+#include "demuxer.hh"
+
+// Keyframe timestamps of one stream, in stream time base and ascending
+// order. Built in a packet-only pass and cached in a sidecar file next to
+// the source, which is reused as long as the source size and modification
+// time match.
+class KeyframeIndex {
+ public:
+  explicit KeyframeIndex(std::vector<int64_t> keyframes = {},
+                         int stream_index = -1);
+
+  static KeyframeIndex Build(Demuxer& demuxer, const AVStream* stream);
+  static std::optional<KeyframeIndex> Load(std::string_view filename);
+  static KeyframeIndex LoadOrBuild(std::string_view filename,
+                                   bool sidecar = true);
+  void Save(std::string_view filename) const;
+
+  // Returns the last keyframe at or before `timestamp`.
+  std::optional<int64_t> Find(int64_t timestamp) const;
+  // Returns the keyframe following `keyframe`.
+  std::optional<int64_t> Next(int64_t keyframe) const;
+  const std::vector<int64_t>& Keyframes() const noexcept;
+  int StreamIndex() const noexcept;
+
+  static std::string SidecarPath(std::string_view filename);
+  static void Register(py::module_& m);
+
+ private:
+  std::vector<int64_t> keyframes_;
+  int stream_index_;
+};
@@ -0,0 +1,126 @@
+#include "keyframe_scanner.hh"
+
+#include "exclusive.hh"
+#include "keyframe_index.hh"
+
+KeyframeScanner::KeyframeScanner(std::string_view filename, double interval,
+                                 const std::optional<std::string>& decoder,
+                                 const CodecConfig& config, bool sidecar) {
+  demuxer_.emplace(filename);
+  stream_ = demuxer_->FindBestStream(AVMEDIA_TYPE_VIDEO);
+  if (stream_ == nullptr) {
+    Throw("could not find video stream in ", filename);
+  }
+  demuxer_->SelectStreams({stream_->index});
+  auto scan_config = config;
+  if (!scan_config.skip_frame) {
+    scan_config.skip_frame = CodecConfig::Discard::NONKEY;
+  }
+  if (decoder) {
+    decoder_.emplace(*decoder, scan_config, stream_);
+  } else {
+    auto codec = avcodec_find_decoder(stream_->codecpar->codec_id);
+    if (codec == nullptr) {
+      Throw("could not find decoder for ", filename);
+    }
+    decoder_.emplace(codec, scan_config, stream_);
+  }
+  if (0 < interval) {
+    auto index = KeyframeIndex::LoadOrBuild(filename, sidecar);
+    if (index.StreamIndex() != stream_->index) {
+      index = KeyframeIndex::Build(*demuxer_, stream_);
+    }
+    auto step = static_cast<int64_t>(interval / av_q2d(stream_->time_base));
+    targets_.emplace();
+    for (auto keyframe : index.Keyframes()) {
+      if (targets_->empty() || targets_->back() + step <= keyframe) {
+        targets_->push_back(keyframe);
+      }
+    }
+  }
+}
+
+std::optional<Frame> KeyframeScanner::Next() {
+  for (;;) {
+    if (auto frame = decoder_->Receive()) {
+      return frame;
+    }
+    if (draining_) {
+      return std::nullopt;
+    }
+    if (auto packet = ReadKeyframe()) {
+      decoder_->Send(*packet);
+    } else {
+      decoder_->Flush();
+      draining_ = true;
+    }
+  }
+}
+
+void KeyframeScanner::Rewind() {
+  if (targets_) {
+    next_ = 0;
+  } else {
+    demuxer_->Seek(stream_, stream_->start_time != AV_NOPTS_VALUE
+                                ? stream_->start_time
+                                : 0);
+  }
+  decoder_->Reset();
+  draining_ = false;
+}
+
+const AVStream* KeyframeScanner::Stream() const noexcept {
+  return stream_;
+}
+
+std::optional<Packet> KeyframeScanner::ReadKeyframe() {
+  if (!targets_) {
+    for (auto packet = demuxer_->Read(stream_); packet;
+         packet = demuxer_->Read(stream_)) {
+      if ((*packet)->flags & AV_PKT_FLAG_KEY) {
+        return packet;
+      }
+    }
+    return std::nullopt;
+  }
+  // A seek lands on the keyframe itself, so the first key packet read is
+  // the target.
+  while (next_ < targets_->size()) {
+    demuxer_->Seek(stream_, (*targets_)[next_++]);
+    for (auto packet = demuxer_->Read(stream_); packet;
+         packet = demuxer_->Read(stream_)) {
+      if ((*packet)->flags & AV_PKT_FLAG_KEY) {
+        return packet;
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+void KeyframeScanner::Register(py::module_& m) {
+  auto c = py::class_<KeyframeScanner>(m, "KeyframeScanner");
+
+  c.def(py::init([](std::string_view filename, double interval,
+                    const std::optional<std::string>& decoder,
+                    const CodecConfig& config, bool sidecar) {
+          py::gil_scoped_release release{};
+          return std::make_unique<KeyframeScanner>(filename, interval, decoder,
+                                                   config, sidecar);
+        }),
+        py::arg("filename"), py::arg("interval") = 0.0,
+        py::arg("decoder") = py::none{}, py::arg("config") = CodecConfig{},
+        py::arg("sidecar") = true);
+
+  c.def("next", Exclusive(&KeyframeScanner::Next));
+  c.def("rewind", Exclusive(&KeyframeScanner::Rewind));
+  c.def("__iter__", [](py::object self) { return self; });
+  c.def("__next__", [](KeyframeScanner& s) {
+    auto frame = Exclusive(&KeyframeScanner::Next)(s);
+    if (!frame) {
+      throw py::stop_iteration{};
+    }
+    return std::move(*frame);
+  });
+  c.def_property_readonly("stream", &KeyframeScanner::Stream,
+                          py::return_value_policy::reference_internal);
+}
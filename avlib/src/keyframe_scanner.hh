@@ -0,0 +1,44 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "codec_config.hh"
+#include "common.hh"
+#include "decoder.hh"
+#include "demuxer.hh"
+#include "frame.hh"
+
+// Decodes only the keyframes of a video stream, e.g. for previews and scene
+// sampling. Other packets never reach the decoder, which also discards
+// non-keyframes unless `config` sets skip_frame otherwise. With an
+// `interval` in seconds, keyframes at least that far apart are visited by
+// seeking through the keyframe index instead of reading every packet.
+class KeyframeScanner {
+ public:
+  explicit KeyframeScanner(std::string_view filename, double interval = 0,
+                           const std::optional<std::string>& decoder = {},
+                           const CodecConfig& config = {},
+                           bool sidecar = true);
+  KeyframeScanner(const KeyframeScanner& other) = delete;
+  KeyframeScanner& operator=(const KeyframeScanner& other) = delete;
+
+  // Returns std::nullopt after the last keyframe.
+  std::optional<Frame> Next();
+  void Rewind();
+  const AVStream* Stream() const noexcept;
+
+  static void Register(py::module_& m);
+
+ private:
+  std::optional<Demuxer> demuxer_;
+  const AVStream* stream_;
+  std::optional<Decoder> decoder_;
+  // Keyframes to seek to when scanning with an interval.
+  std::optional<std::vector<int64_t>> targets_;
+  std::size_t next_{0};
+  bool draining_{false};
+
+  std::optional<Packet> ReadKeyframe();
+};
@@ -0,0 +1,258 @@
+#include "layout_converter.hh"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+static AVPixelFormat PixelFormat(Layout layout) {
+  switch (layout) {
+    case Layout::RGBA:
+      return AV_PIX_FMT_RGBA;
+    case Layout::RGB24:
+      return AV_PIX_FMT_RGB24;
+    case Layout::BGR24:
+      return AV_PIX_FMT_BGR24;
+    case Layout::RGB_PLANAR:
+      return AV_PIX_FMT_GBRP;
+    case Layout::YUV420:
+      return AV_PIX_FMT_YUV420P;
+  }
+  Throw("unsupported layout");
+}
+
+static uint16_t ToHalf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+  if (31 <= exponent) {
+    return sign | 0x7c00;
+  }
+  uint32_t shift = 13;
+  uint32_t half = 0;
+  if (exponent <= 0) {
+    if (exponent < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    shift = 14 - exponent;
+    half = sign | (mantissa >> shift);
+  } else {
+    half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> shift);
+  }
+  auto rest = mantissa & ((1u << shift) - 1);
+  auto middle = 1u << (shift - 1);
+  if (middle < rest || (rest == middle && (half & 1))) {
+    ++half;
+  }
+  return half;
+}
+
+static const std::array<float, 256> kFloatTable = [] {
+  std::array<float, 256> table{};
+  for (std::size_t i = 0; i < table.size(); ++i) {
+    table[i] = i / 255.0f;
+  }
+  return table;
+}();
+
+static const std::array<uint16_t, 256> kHalfTable = [] {
+  std::array<uint16_t, 256> table{};
+  for (std::size_t i = 0; i < table.size(); ++i) {
+    table[i] = ToHalf(i / 255.0f);
+  }
+  return table;
+}();
+
+LayoutConverter::LayoutConverter(Layout layout, DType dtype, int width,
+                                 int height, const ScaleOptions& scale)
+    : converter_{PixelFormat(layout), width, height, scale},
+      layout_{layout},
+      dtype_{dtype},
+      width_{width},
+      height_{height} {
+  if (layout_ == Layout::YUV420 && (width_ % 2 || height_ % 2)) {
+    Throw("YUV420 layout requires even frame size");
+  }
+  if (dtype_ != DType::UINT8) {
+    scratch_.resize(Elements());
+  }
+}
+
+void LayoutConverter::Convert(const Frame& src, uint8_t* dst, bool flip) {
+  auto out = dtype_ == DType::UINT8 ? dst : scratch_.data();
+  auto pixels = static_cast<std::size_t>(width_) * height_;
+  switch (layout_) {
+    case Layout::RGB_PLANAR: {
+      // GBRP keeps its planes in G, B, R order.
+      uint8_t* data[] = {out + pixels, out + 2 * pixels, out};
+      int stride[] = {width_, width_, width_};
+      converter_.Convert(src, data, stride);
+      break;
+    }
+    case Layout::YUV420: {
+      uint8_t* data[] = {out, out + pixels, out + pixels + pixels / 4};
+      int stride[] = {width_, width_ / 2, width_ / 2};
+      converter_.Convert(src, data, stride);
+      break;
+    }
+    default:
+      converter_.Convert(src, out, static_cast<int>(Elements() / height_));
+  }
+  if (flip) {
+    Mirror(out);
+  }
+  auto n = Elements();
+  if (dtype_ == DType::FLOAT32) {
+    auto f = reinterpret_cast<float*>(dst);
+    for (std::size_t i = 0; i < n; ++i) {
+      f[i] = kFloatTable[out[i]];
+    }
+  } else if (dtype_ == DType::FLOAT16) {
+    auto h = reinterpret_cast<uint16_t*>(dst);
+    for (std::size_t i = 0; i < n; ++i) {
+      h[i] = kHalfTable[out[i]];
+    }
+  }
+}
+
+// Reverses the order of the `width` pixels of `bytes` bytes in each row.
+static void MirrorRows(uint8_t* data, std::size_t rows, std::size_t width,
+                       std::size_t bytes) {
+  for (std::size_t r = 0; r < rows; ++r) {
+    auto row = data + r * width * bytes;
+    for (std::size_t i = 0, j = width - 1; i < j; ++i, --j) {
+      std::swap_ranges(row + i * bytes, row + (i + 1) * bytes,
+                       row + j * bytes);
+    }
+  }
+}
+
+void LayoutConverter::Mirror(uint8_t* data) const {
+  auto pixels = static_cast<std::size_t>(width_) * height_;
+  switch (layout_) {
+    case Layout::RGBA:
+      MirrorRows(data, height_, width_, 4);
+      break;
+    case Layout::RGB24:
+    case Layout::BGR24:
+      MirrorRows(data, height_, width_, 3);
+      break;
+    case Layout::RGB_PLANAR:
+      MirrorRows(data, 3 * height_, width_, 1);
+      break;
+    case Layout::YUV420:
+      MirrorRows(data, height_, width_, 1);
+      MirrorRows(data + pixels, height_, width_ / 2, 1);
+      break;
+  }
+}
+
+std::size_t LayoutConverter::SampleSize() const noexcept {
+  return Elements() * ElementSize();
+}
+
+std::size_t LayoutConverter::ElementSize() const noexcept {
+  switch (dtype_) {
+    case DType::FLOAT32:
+      return sizeof(float);
+    case DType::FLOAT16:
+      return sizeof(uint16_t);
+    default:
+      return sizeof(uint8_t);
+  }
+}
+
+std::vector<ssize_t> LayoutConverter::Shape(ssize_t batch_size) const {
+  switch (layout_) {
+    case Layout::RGBA:
+      return {batch_size, height_, width_, 4};
+    case Layout::RGB24:
+    case Layout::BGR24:
+      return {batch_size, height_, width_, 3};
+    case Layout::RGB_PLANAR:
+      return {batch_size, 3, height_, width_};
+    case Layout::YUV420:
+      return {batch_size, height_ * 3 / 2, width_};
+  }
+  Throw("unsupported layout");
+}
+
+py::dtype LayoutConverter::NumpyType() const {
+  switch (dtype_) {
+    case DType::FLOAT32:
+      return py::dtype::of<float>();
+    case DType::FLOAT16:
+      return py::dtype{"float16"};
+    default:
+      return py::dtype::of<uint8_t>();
+  }
+}
+
+py::array LayoutConverter::Wrap(std::unique_ptr<uint8_t[]> buffer,
+                                int batch_size,
+                                std::shared_ptr<BufferRing> ring) const {
+  struct Owner {
+    std::shared_ptr<BufferRing> ring;
+    std::unique_ptr<uint8_t[]> buffer;
+
+    ~Owner() {
+      if (ring) {
+        ring->Release(std::move(buffer));
+      }
+    }
+  };
+  auto ptr = buffer.get();
+  auto owner = new Owner{std::move(ring), std::move(buffer)};
+  py::capsule capsule{owner,
+                      [](void* data) { delete static_cast<Owner*>(data); }};
+  return py::array{NumpyType(), Shape(batch_size), ptr, capsule};
+}
+
+py::buffer_info LayoutConverter::Request(const py::buffer& buffer,
+                                         int batch_size) const {
+  auto info = buffer.request(true);
+  if (static_cast<std::size_t>(info.itemsize) != ElementSize()) {
+    Throw("output buffer item size is ", info.itemsize, ", expected ",
+          ElementSize());
+  }
+  auto stride = info.itemsize;
+  for (auto i = info.ndim - 1; 0 <= i; --i) {
+    if (info.shape[i] != 1 && info.strides[i] != stride) {
+      Throw("output buffer must be C-contiguous");
+    }
+    stride *= info.shape[i];
+  }
+  auto size = batch_size * SampleSize();
+  if (static_cast<std::size_t>(stride) != size) {
+    Throw("output buffer has ", stride, " bytes, expected ", size);
+  }
+  return info;
+}
+
+std::size_t LayoutConverter::Elements() const noexcept {
+  auto pixels = static_cast<std::size_t>(width_) * height_;
+  switch (layout_) {
+    case Layout::RGBA:
+      return pixels * 4;
+    case Layout::YUV420:
+      return pixels * 3 / 2;
+    default:
+      return pixels * 3;
+  }
+}
+
+void LayoutConverter::Register(py::module_& m) {
+  py::enum_<Layout>(m, "Layout")
+      .value("RGBA", Layout::RGBA)
+      .value("RGB24", Layout::RGB24)
+      .value("BGR24", Layout::BGR24)
+      .value("RGB_PLANAR", Layout::RGB_PLANAR)
+      .value("YUV420", Layout::YUV420);
+
+  py::enum_<DType>(m, "DType")
+      .value("UINT8", DType::UINT8)
+      .value("FLOAT32", DType::FLOAT32)
+      .value("FLOAT16", DType::FLOAT16);
+}
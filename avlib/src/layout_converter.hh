@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "buffer_ring.hh"
+#include "common.hh"
+#include "converter.hh"
+#include "frame.hh"
+
+enum class Layout : int {
+  RGBA,
+  RGB24,
+  BGR24,
+  RGB_PLANAR,
+  YUV420,
+};
+
+enum class DType : int {
+  UINT8,
+  FLOAT32,
+  FLOAT16,
+};
+
+// Converts frames directly into one sample slot of a contiguous batch in the
+// final layout and dtype. Float outputs are normalized to [0, 1]. YUV420 is
+// stored as the usual I420 image of height * 3 / 2 rows.
+class LayoutConverter {
+ public:
+  explicit LayoutConverter(Layout layout, DType dtype, int width, int height,
+                           const ScaleOptions& scale = {});
+
+  // With `flip`, the sample is mirrored horizontally.
+  void Convert(const Frame& src, uint8_t* dst, bool flip = false);
+  std::size_t SampleSize() const noexcept;
+  std::size_t ElementSize() const noexcept;
+  std::vector<ssize_t> Shape(ssize_t batch_size) const;
+  py::dtype NumpyType() const;
+  // Returns the buffer to `ring` once the array is garbage collected.
+  py::array Wrap(std::unique_ptr<uint8_t[]> buffer, int batch_size,
+                 std::shared_ptr<BufferRing> ring = nullptr) const;
+  // Requests a writable, C-contiguous view large enough for a whole batch.
+  py::buffer_info Request(const py::buffer& buffer, int batch_size) const;
+
+  static void Register(py::module_& m);
+
+ private:
+  Converter converter_;
+  std::vector<uint8_t> scratch_;
+  Layout layout_;
+  DType dtype_;
+  int width_;
+  int height_;
+
+  std::size_t Elements() const noexcept;
+  void Mirror(uint8_t* data) const;
+};
@@ -1,9 +1,44 @@
 #include "packet.hh"
 
+#include <cstring>
+
 Packet::Packet() : handle_{av_packet_alloc()} {
   av_packet_make_refcounted(handle_);
 }
 
+// Copies the data into a padded packet, or wraps it without copying when
+// `padded` says the last AV_INPUT_BUFFER_PADDING_SIZE bytes are zeroed
+// padding, which decoders may read past the end of the payload.
+Packet::Packet(const py::buffer& data, bool padded) : Packet{} {
+  auto info = data.request();
+  auto size = info.itemsize;
+  for (auto i = info.ndim - 1; 0 <= i; --i) {
+    if (info.shape[i] != 1 && info.strides[i] != size) {
+      Throw("packet data must be C-contiguous");
+    }
+    size *= info.shape[i];
+  }
+  av_packet_unref(handle_);
+  if (!padded) {
+    CheckError(av_new_packet(handle_, static_cast<int>(size)));
+    std::memcpy(handle_->data, info.ptr, size);
+    return;
+  }
+  if (size < AV_INPUT_BUFFER_PADDING_SIZE) {
+    Throw("padded packet data is smaller than the padding");
+  }
+  auto ptr = static_cast<uint8_t*>(info.ptr);
+  auto owner = new py::buffer_info{std::move(info)};
+  handle_->buf = av_buffer_create(ptr, size, &ReleaseBufferInfo, owner,
+                                  AV_BUFFER_FLAG_READONLY);
+  if (handle_->buf == nullptr) {
+    delete owner;
+    Throw("could not wrap packet data");
+  }
+  handle_->data = ptr;
+  handle_->size = static_cast<int>(size - AV_INPUT_BUFFER_PADDING_SIZE);
+}
+
 Packet::Packet(const Packet& other) : handle_{av_packet_clone(other.handle_)} {}
 
 Packet::Packet(Packet&& other) noexcept : handle_{av_packet_alloc()} {
@@ -45,9 +80,26 @@ AVPacket* Packet::operator->() const noexcept {
 void Packet::Register(pybind11::module_& m) {
   auto c = py::class_<Packet>{m, "Packet", py::buffer_protocol{}};
   c.def(py::init<>());
+  c.def(py::init<const py::buffer&, bool>(), py::arg("data"),
+        py::arg("padded") = false);
+  c.attr("PADDING") = AV_INPUT_BUFFER_PADDING_SIZE;
   c.def("unref", &Packet::Unref);
   c.def("make_writable", &Packet::MakeWritable);
-  c.def_property_readonly("pts", [](const Packet& p) { return p->pts; });
-  c.def_property_readonly("flags", [](const Packet& p) { return p->flags; });
+  c.def_property(
+      "pts", [](const Packet& p) { return p->pts; },
+      [](const Packet& p, int64_t v) { p->pts = v; });
+  c.def_property(
+      "dts", [](const Packet& p) { return p->dts; },
+      [](const Packet& p, int64_t v) { p->dts = v; });
+  c.def_property(
+      "duration", [](const Packet& p) { return p->duration; },
+      [](const Packet& p, int64_t v) { p->duration = v; });
+  c.def_property(
+      "flags", [](const Packet& p) { return p->flags; },
+      [](const Packet& p, int v) { p->flags = v; });
+  c.def_property(
+      "stream_index", [](const Packet& p) { return p->stream_index; },
+      [](const Packet& p, int v) { p->stream_index = v; });
+  c.def_property_readonly("size", [](const Packet& p) { return p->size; });
   c.def_buffer([](Packet& p) { return py::buffer_info{p->data, p->size}; });
 }
@@ -1,10 +1,12 @@
 #pragma once
 
 #include "common.hh"
+#include "profiler.hh"
 
 class Packet {
  public:
   explicit Packet();
+  explicit Packet(const py::buffer& data, bool padded = false);
   Packet(const Packet& other);
   Packet(Packet&& other) noexcept;
   Packet& operator=(const Packet& other);
@@ -21,4 +23,5 @@ class Packet {
 
  private:
   AVPacket* handle_{nullptr};
+  LiveCount live_{Profiler::live_packets};
 };
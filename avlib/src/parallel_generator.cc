@@ -0,0 +1,219 @@
+#include "parallel_generator.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+#include "exclusive.hh"
+#include "keyframe_index.hh"
+
+ParallelGenerator::ParallelGenerator(std::string_view filename, int width,
+                                     int height, int workers,
+                                     const GeneratorOptions& options)
+    : output_{options.layout, options.dtype,
+              options.SampleSize(width, height).first,
+              options.SampleSize(width, height).second, options.scale},
+      ring_{std::make_shared<BufferRing>(
+          options.batch_size * output_.SampleSize(), options.ring)},
+      batch_size_{options.batch_size} {
+  if (workers < 1) {
+    Throw("invalid number of workers ", workers);
+  }
+  auto keyframes = KeyframeIndex::LoadOrBuild(filename).Keyframes();
+  auto n = std::clamp<std::size_t>(keyframes.size(), 1, workers);
+  workers_.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    auto worker_options = options;
+    worker_options.prefetch = 0;
+    if (options.seed) {
+      worker_options.seed = *options.seed + i;
+    }
+    if (options.cache) {
+      worker_options.cache = Format(*options.cache, '.', i);
+    }
+    if (0 < i) {
+      worker_options.start = keyframes[i * keyframes.size() / n];
+    }
+    if (i + 1 < n) {
+      worker_options.end = keyframes[(i + 1) * keyframes.size() / n];
+    }
+    workers_[i].generator =
+        std::make_unique<Generator>(filename, width, height, worker_options);
+  }
+  // x and y buffers for full worker queues, one sample in flight per worker
+  // and the one being copied.
+  sample_ring_ = std::make_unique<BufferRing>(
+      workers_.front().generator->SampleSize(),
+      2 * (n * (batch_size_ + 1) + 1));
+  Start();
+}
+
+ParallelGenerator::~ParallelGenerator() noexcept {
+  Stop();
+}
+
+void ParallelGenerator::Reset() {
+  Stop();
+  for (auto& worker : workers_) {
+    worker.generator->Reset();
+  }
+  Start();
+}
+
+ParallelGenerator::Batch ParallelGenerator::GenerateBatch() {
+  auto x_buffer = ring_->Acquire();
+  auto y_buffer = ring_->Acquire();
+  if (!Fill(x_buffer.get(), y_buffer.get())) {
+    return {std::nullopt, std::nullopt};
+  }
+  return {output_.Wrap(std::move(x_buffer), batch_size_, ring_),
+          output_.Wrap(std::move(y_buffer), batch_size_, ring_)};
+}
+
+bool ParallelGenerator::GenerateBatchInto(const py::buffer& x_out,
+                                          const py::buffer& y_out) {
+  auto x_info = output_.Request(x_out, batch_size_);
+  auto y_info = output_.Request(y_out, batch_size_);
+  return Fill(static_cast<uint8_t*>(x_info.ptr),
+              static_cast<uint8_t*>(y_info.ptr));
+}
+
+bool ParallelGenerator::Fill(uint8_t* x, uint8_t* y) {
+  auto size = output_.SampleSize();
+  py::gil_scoped_release release{};
+  for (int i = 0; i < batch_size_; ++i) {
+    auto sample = Pop();
+    if (!sample) {
+      return false;
+    }
+    std::memcpy(x + i * size, sample->x.get(), size);
+    std::memcpy(y + i * size, sample->y.get(), size);
+    sample_ring_->Release(std::move(sample->x));
+    sample_ring_->Release(std::move(sample->y));
+  }
+  return true;
+}
+
+void ParallelGenerator::Start() {
+  next_ = 0;
+  for (auto& worker : workers_) {
+    worker.queue = std::make_unique<BoundedQueue<Sample>>(batch_size_);
+    worker.error = nullptr;
+    worker.done = false;
+    worker.thread = std::thread{&ParallelGenerator::Run, std::ref(worker),
+                                std::ref(*sample_ring_)};
+  }
+}
+
+void ParallelGenerator::Stop() noexcept {
+  for (auto& worker : workers_) {
+    if (worker.queue) {
+      worker.queue->Close();
+    }
+  }
+  for (auto& worker : workers_) {
+    if (worker.thread.joinable()) {
+      worker.thread.join();
+    }
+  }
+}
+
+// Takes samples from the workers in round-robin order, skipping workers whose
+// segment is exhausted. Given seeded workers the order is deterministic.
+std::optional<ParallelGenerator::Sample> ParallelGenerator::Pop() {
+  for (std::size_t i = 0; i < workers_.size(); ++i) {
+    auto& worker = workers_[next_++ % workers_.size()];
+    if (worker.done) {
+      continue;
+    }
+    auto sample = worker.queue->Pop();
+    if (sample) {
+      return sample;
+    }
+    worker.done = true;
+    if (worker.error) {
+      std::rethrow_exception(worker.error);
+    }
+  }
+  return std::nullopt;
+}
+
+void ParallelGenerator::Run(Worker& worker, BufferRing& ring) noexcept {
+  try {
+    for (;;) {
+      Sample sample{ring.Acquire(), ring.Acquire()};
+      if (!worker.generator->GenerateSample(sample.x.get(), sample.y.get())) {
+        ring.Release(std::move(sample.x));
+        ring.Release(std::move(sample.y));
+        break;
+      }
+      if (!worker.queue->Push(std::move(sample))) {
+        return;
+      }
+    }
+  } catch (...) {
+    worker.error = std::current_exception();
+  }
+  worker.queue->Close();
+}
+
+void ParallelGenerator::Register(py::module_& m) {
+  auto c = py::class_<ParallelGenerator>(m, "ParallelGenerator");
+
+  c.def(py::init([](std::string_view filename, std::pair<int, int> size,
+                    int batch_size, int workers, int ring, Layout layout,
+                    DType dtype, std::string_view decoder,
+                    std::string_view encoder, std::optional<unsigned> seed,
+                    std::optional<std::string> cache, bool all_damaged,
+                    std::size_t max_buffered, int variants,
+                    std::optional<std::pair<int, int>> crop,
+                    std::optional<std::pair<int, int>> output_size,
+                    bool flip) {
+          GeneratorOptions options{};
+          options.batch_size = batch_size;
+          options.ring = ring;
+          options.layout = layout;
+          options.dtype = dtype;
+          options.decoder = decoder;
+          options.encoder = encoder;
+          options.seed = seed;
+          options.cache = std::move(cache);
+          options.all_damaged = all_damaged;
+          options.max_buffered = max_buffered;
+          options.variants = variants;
+          options.crop = crop;
+          options.output_size = output_size;
+          options.flip = flip;
+          py::gil_scoped_release release{};
+          return std::make_unique<ParallelGenerator>(filename, size.first,
+                                                     size.second, workers,
+                                                     options);
+        }),
+        py::arg("filename"), py::arg("frame_size") = std::pair{1280, 720},
+        py::arg("batch_size") = 32,
+        py::arg("workers") = std::max(1u, std::thread::hardware_concurrency()),
+        py::arg("ring") = 0, py::arg("layout") = Layout::RGBA,
+        py::arg("dtype") = DType::UINT8,
+        py::arg("decoder") = "h264", py::arg("encoder") = "libx264",
+        py::arg("seed") = py::none{}, py::arg("cache") = py::none{},
+        py::arg("all_damaged") = false, py::arg("max_buffered") = 256,
+        py::arg("variants") = 1, py::arg("crop") = py::none{},
+        py::arg("output_size") = py::none{}, py::arg("flip") = false);
+
+  c.def("reset", Exclusive(&ParallelGenerator::Reset));
+  c.def("generate_batch", [](ParallelGenerator& g) {
+    ExclusiveScope scope{&g};
+    return g.GenerateBatch();
+  });
+  c.def(
+      "generate_batch_into",
+      [](ParallelGenerator& g, const py::buffer& x_out,
+         const py::buffer& y_out) {
+        ExclusiveScope scope{&g};
+        return g.GenerateBatchInto(x_out, y_out);
+      },
+      py::arg("x_out"), py::arg("y_out"));
+  c.def_property_readonly("workers", [](const ParallelGenerator& g) {
+    return g.workers_.size();
+  });
+}
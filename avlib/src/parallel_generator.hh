@@ -0,0 +1,58 @@
+#pragma once
+
+#include <exception>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "buffer_ring.hh"
+#include "common.hh"
+#include "generator.hh"
+#include "layout_converter.hh"
+#include "queue.hh"
+
+class ParallelGenerator {
+ public:
+  using Batch = Generator::Batch;
+
+  explicit ParallelGenerator(std::string_view filename, int width, int height,
+                             int workers, const GeneratorOptions& options = {});
+  ParallelGenerator(const ParallelGenerator& other) = delete;
+  ParallelGenerator& operator=(const ParallelGenerator& other) = delete;
+  ~ParallelGenerator() noexcept;
+
+  void Reset();
+  Batch GenerateBatch();
+  bool GenerateBatchInto(const py::buffer& x_out, const py::buffer& y_out);
+
+  static void Register(py::module_& m);
+
+ private:
+  struct Sample {
+    std::unique_ptr<uint8_t[]> x;
+    std::unique_ptr<uint8_t[]> y;
+  };
+
+  struct Worker {
+    std::unique_ptr<Generator> generator;
+    std::unique_ptr<BoundedQueue<Sample>> queue;
+    std::thread thread;
+    std::exception_ptr error;
+    bool done{false};
+  };
+
+  std::vector<Worker> workers_;
+  LayoutConverter output_;
+  std::shared_ptr<BufferRing> ring_;
+  // Sample buffers cycled between the workers and Fill.
+  std::unique_ptr<BufferRing> sample_ring_;
+  std::size_t next_{0};
+  int batch_size_;
+
+  void Start();
+  void Stop() noexcept;
+  std::optional<Sample> Pop();
+  bool Fill(uint8_t* x, uint8_t* y);
+  static void Run(Worker& worker, BufferRing& ring) noexcept;
+};
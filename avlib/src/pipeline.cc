@@ -0,0 +1,238 @@
+#include "pipeline.hh"
+
+#include <utility>
+
+#include "exclusive.hh"
+
+Pipeline::Pipeline(std::string_view filename, const PipelineOptions& options) {
+  demuxer_.emplace(filename);
+  stream_ = demuxer_->FindBestStream(AVMEDIA_TYPE_VIDEO);
+  if (stream_ == nullptr) {
+    Throw("could not find video stream in ", filename);
+  }
+  demuxer_->SelectStreams({stream_->index});
+  if (options.decoder) {
+    decoder_.emplace(*options.decoder, stream_);
+  } else {
+    auto codec = avcodec_find_decoder(stream_->codecpar->codec_id);
+    if (codec == nullptr) {
+      Throw("could not find decoder for ", filename);
+    }
+    decoder_.emplace(codec, stream_);
+  }
+  if (options.format) {
+    converter_.emplace(*options.format,
+                       options.width ? options.width : (*decoder_)->width,
+                       options.height ? options.height : (*decoder_)->height,
+                       options.scale);
+  }
+  if (options.encoder) {
+    encoder_.emplace(*options.encoder, options.config);
+  }
+
+  AddStage(
+      "demux", [this](Input, Stage& stage) { Demux(stage); }, options.depth);
+  AddStage(
+      "decode",
+      [this](Input input, Stage& stage) { Decode(input, stage); },
+      options.depth);
+  if (converter_) {
+    AddStage(
+        "convert",
+        [this](Input input, Stage& stage) { Convert(input, stage); },
+        options.depth);
+  }
+  if (encoder_) {
+    AddStage(
+        "encode",
+        [this](Input input, Stage& stage) { Encode(input, stage); },
+        options.depth);
+  }
+
+  if (0 < options.read_ahead) {
+    demuxer_->StartReadAhead(options.read_ahead);
+  }
+  for (std::size_t i = 0; i < stages_.size(); ++i) {
+    Input input = 0 < i ? stages_[i - 1]->output.get() : nullptr;
+    stages_[i]->thread =
+        std::thread{&Pipeline::Run, this, std::ref(*stages_[i]), input};
+  }
+}
+
+Pipeline::~Pipeline() noexcept {
+  Close();
+}
+
+std::optional<Pipeline::Item> Pipeline::Next() {
+  auto item = stages_.back()->output->Pop();
+  if (!item) {
+    for (auto& stage : stages_) {
+      if (stage->error) {
+        std::rethrow_exception(stage->error);
+      }
+    }
+  }
+  return item;
+}
+
+void Pipeline::Close() noexcept {
+  for (auto& stage : stages_) {
+    stage->output->Close();
+  }
+  for (auto& stage : stages_) {
+    if (stage->thread.joinable()) {
+      stage->thread.join();
+    }
+  }
+}
+
+std::vector<Pipeline::StageStats> Pipeline::Stats() const {
+  std::vector<StageStats> stats{};
+  for (auto& stage : stages_) {
+    stats.push_back({stage->name, stage->items.load(),
+                     stage->output->Size(), stage->output->Capacity(),
+                     stage->output->PushWaits(), stage->output->PopWaits()});
+  }
+  return stats;
+}
+
+void Pipeline::AddStage(std::string name,
+                        std::function<void(Input, Stage&)> work,
+                        std::size_t depth) {
+  auto& stage = *stages_.emplace_back(std::make_unique<Stage>());
+  stage.name = std::move(name);
+  stage.work = std::move(work);
+  stage.output = std::make_unique<BoundedQueue<Item>>(depth);
+}
+
+// Closing every queue on failure unblocks the other stages, which then stop
+// because their Push or Pop fails.
+void Pipeline::Run(Stage& stage, Input input) noexcept {
+  try {
+    stage.work(input, stage);
+  } catch (...) {
+    stage.error = std::current_exception();
+    for (auto& other : stages_) {
+      other->output->Close();
+    }
+  }
+  stage.output->Close();
+}
+
+bool Pipeline::Emit(Stage& stage, Item item) {
+  if (!stage.output->Push(std::move(item))) {
+    return false;
+  }
+  ++stage.items;
+  return true;
+}
+
+void Pipeline::Demux(Stage& stage) {
+  Packet packet{};
+  while (demuxer_->Read(packet, stream_)) {
+    if (!Emit(stage, std::move(packet))) {
+      return;
+    }
+  }
+}
+
+void Pipeline::Decode(Input input, Stage& stage) {
+  for (auto item = input->Pop(); item; item = input->Pop()) {
+    decoder_->Send(std::get<Packet>(*item));
+    for (auto frame = decoder_->Receive(); frame; frame = decoder_->Receive()) {
+      if (!Emit(stage, std::move(*frame))) {
+        return;
+      }
+    }
+  }
+  decoder_->Flush();
+  for (auto frame = decoder_->Receive(); frame; frame = decoder_->Receive()) {
+    if (!Emit(stage, std::move(*frame))) {
+      return;
+    }
+  }
+}
+
+void Pipeline::Convert(Input input, Stage& stage) {
+  for (auto item = input->Pop(); item; item = input->Pop()) {
+    if (!Emit(stage, converter_->Convert(std::get<Frame>(*item)))) {
+      return;
+    }
+  }
+}
+
+void Pipeline::Encode(Input input, Stage& stage) {
+  for (auto item = input->Pop(); item; item = input->Pop()) {
+    encoder_->Send(std::get<Frame>(*item));
+    for (auto packet = encoder_->Receive(); packet;
+         packet = encoder_->Receive()) {
+      if (!Emit(stage, std::move(*packet))) {
+        return;
+      }
+    }
+  }
+  encoder_->Flush();
+  for (auto packet = encoder_->Receive(); packet;
+       packet = encoder_->Receive()) {
+    if (!Emit(stage, std::move(*packet))) {
+      return;
+    }
+  }
+}
+
+void Pipeline::Register(py::module_& m) {
+  auto c = py::class_<Pipeline>(m, "Pipeline");
+
+  c.def(py::init([](std::string_view filename,
+                    const std::optional<std::string>& decoder,
+                    std::optional<AVPixelFormat> format,
+                    std::optional<std::pair<int, int>> size,
+                    const std::optional<std::string>& encoder,
+                    const std::optional<CodecConfig>& config,
+                    std::size_t depth, std::size_t read_ahead) {
+          PipelineOptions options{};
+          options.decoder = decoder;
+          options.format = format;
+          if (size) {
+            options.width = size->first;
+            options.height = size->second;
+          }
+          options.encoder = encoder;
+          if (config) {
+            options.config = *config;
+          }
+          options.depth = depth;
+          options.read_ahead = read_ahead;
+          py::gil_scoped_release release{};
+          return std::make_unique<Pipeline>(filename, options);
+        }),
+        py::arg("filename"), py::arg("decoder") = py::none{},
+        py::arg("format") = py::none{}, py::arg("size") = py::none{},
+        py::arg("encoder") = py::none{}, py::arg("config") = py::none{},
+        py::arg("depth") = 8, py::arg("read_ahead") = 0);
+
+  c.def("next", Exclusive(&Pipeline::Next));
+  c.def("close", Exclusive(&Pipeline::Close));
+  c.def("__iter__", [](py::object self) { return self; });
+  c.def("__next__", [](Pipeline& p) {
+    auto item = Exclusive(&Pipeline::Next)(p);
+    if (!item) {
+      throw py::stop_iteration{};
+    }
+    return std::move(*item);
+  });
+  c.def("stats", [](const Pipeline& p) {
+    py::list stats{};
+    for (auto& stage : p.Stats()) {
+      py::dict d{};
+      d["name"] = stage.name;
+      d["items"] = stage.items;
+      d["depth"] = stage.depth;
+      d["capacity"] = stage.capacity;
+      d["push_waits"] = stage.push_waits;
+      d["pop_waits"] = stage.pop_waits;
+      stats.append(d);
+    }
+    return stats;
+  });
+}
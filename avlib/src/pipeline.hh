@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "codec_config.hh"
+#include "common.hh"
+#include "converter.hh"
+#include "decoder.hh"
+#include "demuxer.hh"
+#include "encoder.hh"
+#include "queue.hh"
+
+struct PipelineOptions {
+  // Defaults to the decoder of the stream codec.
+  std::optional<std::string> decoder;
+  // Adds a convert stage; a zero size keeps the source size.
+  std::optional<AVPixelFormat> format;
+  int width{0};
+  int height{0};
+  ScaleOptions scale;
+  // Adds an encode stage configured by `config`. Frames keep the source
+  // timestamps, so `config.timebase` should match the stream time base.
+  std::optional<std::string> encoder;
+  CodecConfig config;
+  // Capacity of the queue after each stage.
+  std::size_t depth{8};
+  // Packets demuxed ahead, see Demuxer::StartReadAhead.
+  std::size_t read_ahead{0};
+};
+
+// Demux -> decode -> [convert] -> [encode] chain with one thread per stage
+// and a bounded queue after each stage. Results are taken from the last
+// queue, so Python only pulls finished frames or packets.
+class Pipeline {
+ public:
+  using Item = std::variant<Packet, Frame>;
+
+  struct StageStats {
+    std::string name;
+    std::size_t items;
+    std::size_t depth;
+    std::size_t capacity;
+    // Times the stage blocked on its full output queue.
+    std::size_t push_waits;
+    // Times the next stage blocked on the empty output queue.
+    std::size_t pop_waits;
+  };
+
+  explicit Pipeline(std::string_view filename,
+                    const PipelineOptions& options = {});
+  Pipeline(const Pipeline& other) = delete;
+  Pipeline& operator=(const Pipeline& other) = delete;
+  ~Pipeline() noexcept;
+
+  std::optional<Item> Next();
+  void Close() noexcept;
+  std::vector<StageStats> Stats() const;
+
+  static void Register(py::module_& m);
+
+ private:
+  using Input = BoundedQueue<Item>*;
+
+  struct Stage {
+    std::string name;
+    std::function<void(Input, Stage&)> work;
+    std::unique_ptr<BoundedQueue<Item>> output;
+    std::thread thread;
+    std::exception_ptr error;
+    std::atomic<std::size_t> items{0};
+  };
+
+  std::optional<Demuxer> demuxer_;
+  const AVStream* stream_;
+  std::optional<Decoder> decoder_;
+  std::optional<Converter> converter_;
+  std::optional<Encoder> encoder_;
+  std::vector<std::unique_ptr<Stage>> stages_;
+
+  void AddStage(std::string name, std::function<void(Input, Stage&)> work,
+                std::size_t depth);
+  void Run(Stage& stage, Input input) noexcept;
+  static bool Emit(Stage& stage, Item item);
+
+  void Demux(Stage& stage);
+  void Decode(Input input, Stage& stage);
+  void Convert(Input input, Stage& stage);
+  void Encode(Input input, Stage& stage);
+};
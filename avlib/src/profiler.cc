@@ -0,0 +1,161 @@
+#include "profiler.hh"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+struct TraceEvent {
+  const char* name;
+  uint32_t thread;
+  int64_t start;
+  int64_t end;
+};
+
+struct ProfilerState {
+  std::mutex mutex;
+  // A deque keeps the stages in place as more are registered.
+  std::deque<ProfileStage> stages;
+  std::vector<TraceEvent> events;
+  std::atomic<bool> tracing{false};
+  std::size_t next{0};
+  bool wrapped{false};
+};
+
+static ProfilerState& State() {
+  static ProfilerState state{};
+  return state;
+}
+
+static uint32_t ThreadId() {
+  static std::atomic<uint32_t> next{1};
+  thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+  return id;
+}
+
+ProfileStage& Profiler::Stage(const char* name) {
+  auto& state = State();
+  std::lock_guard lock{state.mutex};
+  for (auto& stage : state.stages) {
+    if (std::strcmp(stage.name, name) == 0) {
+      return stage;
+    }
+  }
+  auto& stage = state.stages.emplace_back();
+  stage.name = name;
+  return stage;
+}
+
+void Profiler::Enable(std::size_t trace_events) {
+  auto& state = State();
+  std::lock_guard lock{state.mutex};
+  state.events.assign(trace_events, TraceEvent{});
+  state.next = 0;
+  state.wrapped = false;
+  state.tracing.store(0 < trace_events, std::memory_order_relaxed);
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::Disable() noexcept {
+  enabled_.store(false, std::memory_order_relaxed);
+}
+
+void Profiler::Reset() {
+  auto& state = State();
+  std::lock_guard lock{state.mutex};
+  for (auto& stage : state.stages) {
+    stage.calls = 0;
+    stage.nanos = 0;
+    stage.bytes = 0;
+    stage.frames = 0;
+  }
+  state.next = 0;
+  state.wrapped = false;
+}
+
+void Profiler::Record(ProfileStage& stage, int64_t start, int64_t end,
+                      uint64_t bytes, uint64_t frames) noexcept {
+  stage.calls.fetch_add(1, std::memory_order_relaxed);
+  stage.nanos.fetch_add(end - start, std::memory_order_relaxed);
+  stage.bytes.fetch_add(bytes, std::memory_order_relaxed);
+  stage.frames.fetch_add(frames, std::memory_order_relaxed);
+  auto& state = State();
+  if (!state.tracing.load(std::memory_order_relaxed)) {
+    return;
+  }
+  std::lock_guard lock{state.mutex};
+  if (state.events.empty()) {
+    return;
+  }
+  state.events[state.next] = TraceEvent{stage.name, ThreadId(), start, end};
+  if (++state.next == state.events.size()) {
+    state.next = 0;
+    state.wrapped = true;
+  }
+}
+
+// Complete ("X") events with microsecond timestamps, oldest first.
+std::string Profiler::TraceJson() {
+  auto& state = State();
+  std::lock_guard lock{state.mutex};
+  std::ostringstream str;
+  str << std::fixed << std::setprecision(3);
+  str << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  auto count = state.wrapped ? state.events.size() : state.next;
+  auto first = state.wrapped ? state.next : 0;
+  auto pid = getpid();
+  for (std::size_t i = 0; i < count; ++i) {
+    auto& event = state.events[(first + i) % state.events.size()];
+    str << (i ? "," : "") << "{\"name\":\"" << event.name
+        << "\",\"cat\":\"avlib\",\"ph\":\"X\",\"pid\":" << pid
+        << ",\"tid\":" << event.thread << ",\"ts\":" << event.start / 1e3
+        << ",\"dur\":" << (event.end - event.start) / 1e3 << '}';
+  }
+  str << "]}";
+  return str.str();
+}
+
+void Profiler::Register(py::module_& m) {
+  auto p = m.def_submodule("profiler", "stage statistics and tracing");
+
+  p.def("enable", &Profiler::Enable, py::arg("trace_events") = 0);
+  p.def("disable", &Profiler::Disable);
+  p.def("enabled", &Profiler::Enabled);
+  p.def("reset", &Profiler::Reset);
+  p.def("stats", [] {
+    py::dict stages{};
+    {
+      auto& state = State();
+      std::lock_guard lock{state.mutex};
+      for (auto& stage : state.stages) {
+        py::dict d{};
+        d["calls"] = stage.calls.load();
+        d["seconds"] = stage.nanos.load() / 1e9;
+        d["bytes"] = stage.bytes.load();
+        d["frames"] = stage.frames.load();
+        stages[stage.name] = d;
+      }
+    }
+    py::dict stats{};
+    stats["stages"] = stages;
+    stats["live_frames"] = live_frames.load();
+    stats["live_packets"] = live_packets.load();
+    return stats;
+  });
+  p.def("trace_json", &Profiler::TraceJson);
+  p.def(
+      "save_trace",
+      [](const std::string& filename) {
+        std::ofstream out{filename};
+        out << TraceJson();
+        if (!out) {
+          Throw("could not write ", filename);
+        }
+      },
+      py::arg("filename"));
+}
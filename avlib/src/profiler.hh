@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "common.hh"
+
+// Cumulative time, calls, bytes and frames of one instrumented stage.
+struct ProfileStage {
+  const char* name;
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> nanos{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> frames{0};
+};
+
+// Process-wide stage statistics and an optional ring buffer of trace events
+// exported as Chrome/Perfetto trace JSON. Both are off by default; a
+// disabled ProfileScope or LiveCount costs one relaxed load. Live frame and
+// packet counts cover the instances created while enabled.
+class Profiler {
+ public:
+  // Returns the stage of `name`, a string literal, registering it on first
+  // use. Call sites keep the reference in a function-local static.
+  static ProfileStage& Stage(const char* name);
+  // Keeps the last `trace_events` events if non-zero.
+  static void Enable(std::size_t trace_events = 0);
+  static void Disable() noexcept;
+  static void Reset();
+  static void Record(ProfileStage& stage, int64_t start, int64_t end,
+                     uint64_t bytes, uint64_t frames) noexcept;
+  static std::string TraceJson();
+
+  static bool Enabled() noexcept {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  static int64_t Now() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  inline static std::atomic<int64_t> live_frames{0};
+  inline static std::atomic<int64_t> live_packets{0};
+
+  static void Register(py::module_& m);
+
+ private:
+  inline static std::atomic<bool> enabled_{false};
+};
+
+// Times a block into a stage while the profiler is enabled.
+class ProfileScope {
+ public:
+  explicit ProfileScope(ProfileStage& stage) noexcept
+      : stage_{Profiler::Enabled() ? &stage : nullptr} {
+    if (stage_) {
+      start_ = Profiler::Now();
+    }
+  }
+  ProfileScope(const ProfileScope& other) = delete;
+  ProfileScope& operator=(const ProfileScope& other) = delete;
+
+  ~ProfileScope() {
+    if (stage_) {
+      Profiler::Record(*stage_, start_, Profiler::Now(), bytes_, frames_);
+    }
+  }
+
+  void Add(uint64_t bytes, uint64_t frames = 0) noexcept {
+    bytes_ += bytes;
+    frames_ += frames;
+  }
+
+ private:
+  ProfileStage* stage_;
+  int64_t start_{0};
+  uint64_t bytes_{0};
+  uint64_t frames_{0};
+};
+
+// Runs `fn` timed into `stage`.
+template <typename Fn>
+auto Profiled(ProfileStage& stage, Fn&& fn) {
+  ProfileScope scope{stage};
+  return fn();
+}
+
+// Member that counts the live instances of its owner in `count` if created
+// while the profiler is enabled. Instances remember whether they were
+// counted, so toggling the profiler does not skew the count.
+class LiveCount {
+ public:
+  explicit LiveCount(std::atomic<int64_t>& count) noexcept
+      : count_{&count}, counted_{Profiler::Enabled()} {
+    if (counted_) {
+      count_->fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  LiveCount(const LiveCount& other) noexcept : LiveCount{*other.count_} {}
+  LiveCount& operator=(const LiveCount&) noexcept {
+    return *this;
+  }
+  ~LiveCount() {
+    if (counted_) {
+      count_->fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  std::atomic<int64_t>* count_;
+  bool counted_;
+};
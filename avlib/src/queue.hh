@@ -0,0 +1,108 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+template <typename Tp>
+class BoundedQueue {
+ public:
+  // Bounded by `capacity` items and, if non-zero, by `max_bytes` of the
+  // weights passed to Push. An item heavier than `max_bytes` is still
+  // accepted into an empty queue.
+  explicit BoundedQueue(std::size_t capacity, std::size_t max_bytes = 0)
+      : capacity_{capacity < 1 ? 1 : capacity}, max_bytes_{max_bytes} {}
+  BoundedQueue(const BoundedQueue& other) = delete;
+  BoundedQueue& operator=(const BoundedQueue& other) = delete;
+
+  // Blocks while the queue is full. Returns false if the queue was closed.
+  bool Push(Tp value, std::size_t bytes = 0) {
+    std::unique_lock lock{mutex_};
+    auto ready = [&] { return closed_ || HasRoom(bytes); };
+    if (!ready()) {
+      ++push_waits_;
+      not_full_.wait(lock, ready);
+    }
+    if (closed_) {
+      return false;
+    }
+    items_.emplace_back(std::move(value), bytes);
+    bytes_ += bytes;
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Blocks while the queue is empty. Returns std::nullopt once the queue is
+  // closed and drained.
+  std::optional<Tp> Pop() {
+    std::unique_lock lock{mutex_};
+    auto ready = [&] { return closed_ || !items_.empty(); };
+    if (!ready()) {
+      ++pop_waits_;
+      not_empty_.wait(lock, ready);
+    }
+    if (items_.empty()) {
+      return std::nullopt;
+    }
+    auto [value, bytes] = std::move(items_.front());
+    items_.pop_front();
+    bytes_ -= bytes;
+    not_full_.notify_one();
+    return std::move(value);
+  }
+
+  void Close() noexcept {
+    std::lock_guard lock{mutex_};
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+  std::size_t Size() const {
+    std::lock_guard lock{mutex_};
+    return items_.size();
+  }
+
+  std::size_t Bytes() const {
+    std::lock_guard lock{mutex_};
+    return bytes_;
+  }
+
+  std::size_t Capacity() const noexcept {
+    return capacity_;
+  }
+
+  // Number of Push calls that blocked on a full queue.
+  std::size_t PushWaits() const {
+    std::lock_guard lock{mutex_};
+    return push_waits_;
+  }
+
+  // Number of Pop calls that blocked on an empty queue.
+  std::size_t PopWaits() const {
+    std::lock_guard lock{mutex_};
+    return pop_waits_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::deque<std::pair<Tp, std::size_t>> items_;
+  std::size_t capacity_;
+  std::size_t max_bytes_;
+  std::size_t bytes_{0};
+  std::size_t push_waits_{0};
+  std::size_t pop_waits_{0};
+  bool closed_{false};
+
+  bool HasRoom(std::size_t bytes) const noexcept {
+    if (capacity_ <= items_.size()) {
+      return false;
+    }
+    return max_bytes_ == 0 || items_.empty() || bytes_ + bytes <= max_bytes_;
+  }
+};
@@ -0,0 +1,660 @@
+#include "shard.hh"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+
+#ifdef AVLIB_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef AVLIB_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "exclusive.hh"
+
+static constexpr char kMagic[8] = {'A', 'V', 'L', 'S', 'H', 'D', '0', '1'};
+static constexpr std::size_t kAlignment = 64;
+
+struct ShardHeader {
+  char magic[8];
+  int32_t compression;
+  int32_t layout;
+  int32_t dtype;
+  int32_t width;
+  int32_t height;
+  int32_t reserved;
+  uint64_t chunk_size;
+  uint64_t chunks;
+  uint64_t samples;
+  uint64_t index_offset;
+};
+
+static_assert(sizeof(ShardHeader) == kAlignment);
+
+static const char* Name(Compression compression) {
+  switch (compression) {
+    case Compression::NONE:
+      return "no";
+    case Compression::LZ4:
+      return "LZ4";
+    case Compression::ZSTD:
+      return "zstd";
+  }
+  return "unknown";
+}
+
+static void CheckCompression(Compression compression) {
+  switch (compression) {
+    case Compression::NONE:
+      return;
+#ifdef AVLIB_WITH_LZ4
+    case Compression::LZ4:
+      return;
+#endif
+#ifdef AVLIB_WITH_ZSTD
+    case Compression::ZSTD:
+      return;
+#endif
+    default:
+      break;
+  }
+  Throw("avlib was built without ", Name(compression), " compression");
+}
+
+static std::vector<uint8_t> Compress(Compression compression,
+                                     const uint8_t* data, std::size_t size,
+                                     int level) {
+  std::vector<uint8_t> out;
+  switch (compression) {
+#ifdef AVLIB_WITH_LZ4
+    case Compression::LZ4: {
+      if (LZ4_MAX_INPUT_SIZE < size) {
+        Throw("chunk of ", size, " bytes is too large for LZ4");
+      }
+      out.resize(LZ4_compressBound(static_cast<int>(size)));
+      auto ret = LZ4_compress_fast(reinterpret_cast<const char*>(data),
+                                   reinterpret_cast<char*>(out.data()),
+                                   static_cast<int>(size),
+                                   static_cast<int>(out.size()),
+                                   std::max(level, 1));
+      if (ret <= 0) {
+        Throw("LZ4 compression failed");
+      }
+      out.resize(ret);
+      return out;
+    }
+#endif
+#ifdef AVLIB_WITH_ZSTD
+    case Compression::ZSTD: {
+      out.resize(ZSTD_compressBound(size));
+      auto ret = ZSTD_compress(out.data(), out.size(), data, size, level);
+      if (ZSTD_isError(ret)) {
+        Throw("zstd compression failed: ", ZSTD_getErrorName(ret));
+      }
+      out.resize(ret);
+      return out;
+    }
+#endif
+    default:
+      break;
+  }
+  Throw("avlib was built without ", Name(compression), " compression");
+}
+
+static void Decompress(Compression compression, const uint8_t* src,
+                       std::size_t size, uint8_t* dst, std::size_t expected) {
+  switch (compression) {
+#ifdef AVLIB_WITH_LZ4
+    case Compression::LZ4: {
+      auto ret = LZ4_decompress_safe(reinterpret_cast<const char*>(src),
+                                     reinterpret_cast<char*>(dst),
+                                     static_cast<int>(size),
+                                     static_cast<int>(expected));
+      if (ret < 0 || static_cast<std::size_t>(ret) != expected) {
+        Throw("corrupt LZ4 chunk");
+      }
+      return;
+    }
+#endif
+#ifdef AVLIB_WITH_ZSTD
+    case Compression::ZSTD: {
+      auto ret = ZSTD_decompress(dst, expected, src, size);
+      if (ZSTD_isError(ret) || ret != expected) {
+        Throw("corrupt zstd chunk");
+      }
+      return;
+    }
+#endif
+    default:
+      break;
+  }
+  Throw("avlib was built without ", Name(compression), " compression");
+}
+
+static void Pad(std::ofstream& out, std::size_t alignment) {
+  static const char zeros[kAlignment] = {};
+  auto position = static_cast<std::size_t>(out.tellp());
+  out.write(zeros, (alignment - position % alignment) % alignment);
+}
+
+// Asks the kernel to read a mapped range ahead of its first access.
+static void WillNeed(const uint8_t* data, std::size_t size) {
+  static const auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  auto begin = reinterpret_cast<uintptr_t>(data) & ~(page - 1);
+  auto end = reinterpret_cast<uintptr_t>(data) + size;
+  madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+}
+
+ShardWriter::ShardWriter(std::string prefix, Layout layout, DType dtype,
+                         int width, int height, std::size_t chunk_size,
+                         std::size_t shard_chunks, Compression compression,
+                         int level)
+    : prefix_{std::move(prefix)},
+      output_{layout, dtype, width, height},
+      layout_{layout},
+      dtype_{dtype},
+      width_{width},
+      height_{height},
+      compression_{compression},
+      level_{level},
+      chunk_size_{std::max<std::size_t>(chunk_size, 1)},
+      shard_chunks_{std::max<std::size_t>(shard_chunks, 1)} {
+  CheckCompression(compression_);
+  chunk_.resize(2 * chunk_size_ * output_.SampleSize());
+}
+
+ShardWriter::~ShardWriter() noexcept {
+  try {
+    Close();
+  } catch (...) {
+    out_.close();
+    std::remove(temp_.c_str());
+  }
+}
+
+void ShardWriter::Write(const uint8_t* x, const uint8_t* y) {
+  auto size = output_.SampleSize();
+  std::memcpy(&chunk_[filled_ * size], x, size);
+  std::memcpy(&chunk_[(chunk_size_ + filled_) * size], y, size);
+  if (++filled_ == chunk_size_) {
+    FlushChunk();
+  }
+}
+
+std::size_t ShardWriter::WriteFrom(Generator& generator, std::size_t samples) {
+  auto size = output_.SampleSize();
+  if (generator.SampleSize() != size) {
+    Throw("generator sample size is ", generator.SampleSize(), ", expected ",
+          size);
+  }
+  if (generator.Prefetching()) {
+    Throw("cannot write samples of a prefetching generator");
+  }
+  std::size_t written = 0;
+  for (; written < samples; ++written) {
+    if (!generator.GenerateSample(&chunk_[filled_ * size],
+                                  &chunk_[(chunk_size_ + filled_) * size])) {
+      break;
+    }
+    if (++filled_ == chunk_size_) {
+      FlushChunk();
+    }
+  }
+  return written;
+}
+
+void ShardWriter::Close() {
+  FlushChunk();
+  if (out_.is_open()) {
+    CloseShard();
+  }
+}
+
+const std::vector<std::string>& ShardWriter::Paths() const noexcept {
+  return paths_;
+}
+
+std::size_t ShardWriter::SampleSize() const noexcept {
+  return output_.SampleSize();
+}
+
+void ShardWriter::OpenShard() {
+  path_ = Format(prefix_, "-", std::setw(5), std::setfill('0'), paths_.size(),
+                 ".avs");
+  temp_ = path_ + ".tmp";
+  out_.open(temp_, std::ios::binary | std::ios::trunc);
+  if (!out_) {
+    Throw("could not open ", temp_);
+  }
+  index_.clear();
+  WriteHeader(0);
+}
+
+void ShardWriter::FlushChunk() {
+  if (filled_ == 0) {
+    return;
+  }
+  if (!out_.is_open()) {
+    OpenShard();
+  }
+  // The y samples of a partial chunk are moved up behind its x samples.
+  auto bytes = filled_ * output_.SampleSize();
+  if (filled_ < chunk_size_) {
+    std::memmove(&chunk_[bytes], &chunk_[chunk_size_ * output_.SampleSize()],
+                 bytes);
+  }
+  const uint8_t* data = chunk_.data();
+  std::size_t size = 2 * bytes;
+  std::vector<uint8_t> compressed;
+  if (compression_ != Compression::NONE) {
+    compressed = Compress(compression_, data, size, level_);
+    data = compressed.data();
+    size = compressed.size();
+  }
+  ShardChunk entry{static_cast<uint64_t>(out_.tellp()), size, filled_};
+  out_.write(reinterpret_cast<const char*>(data), size);
+  Pad(out_, kAlignment);
+  if (!out_) {
+    Throw("could not write ", temp_);
+  }
+  index_.push_back(entry);
+  filled_ = 0;
+  if (index_.size() == shard_chunks_) {
+    CloseShard();
+  }
+}
+
+void ShardWriter::CloseShard() {
+  auto index_offset = static_cast<uint64_t>(out_.tellp());
+  out_.write(reinterpret_cast<const char*>(index_.data()),
+             index_.size() * sizeof(ShardChunk));
+  out_.seekp(0);
+  WriteHeader(index_offset);
+  out_.close();
+  if (!out_) {
+    Throw("could not write ", temp_);
+  }
+  std::filesystem::rename(temp_, path_);
+  paths_.push_back(path_);
+  temp_.clear();
+}
+
+void ShardWriter::WriteHeader(uint64_t index_offset) {
+  ShardHeader header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.compression = static_cast<int32_t>(compression_);
+  header.layout = static_cast<int32_t>(layout_);
+  header.dtype = static_cast<int32_t>(dtype_);
+  header.width = width_;
+  header.height = height_;
+  header.chunk_size = chunk_size_;
+  header.chunks = index_.size();
+  for (auto& chunk : index_) {
+    header.samples += chunk.samples;
+  }
+  header.index_offset = index_offset;
+  out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+ShardLoader::ShardLoader(const std::vector<std::string>& paths, bool shuffle,
+                         std::optional<unsigned> seed, std::size_t window,
+                         std::size_t threads, std::size_t batch_size)
+    : shuffle_{shuffle},
+      engine_{seed ? *seed : std::random_device{}()},
+      window_{std::max<std::size_t>(window, 1)},
+      batch_size_{batch_size} {
+  if (paths.empty()) {
+    Throw("no shards given");
+  }
+  for (auto& path : paths) {
+    Open(path);
+  }
+  auto compressed = std::any_of(shards_.begin(), shards_.end(), [](auto& s) {
+    return s.compression != Compression::NONE;
+  });
+  if (compressed) {
+    pool_ = std::make_unique<ThreadPool>(threads);
+    ring_ = std::make_shared<BufferRing>(
+        2 * chunk_size_ * output_->SampleSize(), window_ + pool_->Size() + 2);
+  }
+  if (batch_size_) {
+    batch_ring_ = std::make_shared<BufferRing>(
+        batch_size_ * output_->SampleSize(), 4);
+  }
+  Reset();
+}
+
+ShardLoader::~ShardLoader() noexcept {
+  Stop();
+}
+
+void ShardLoader::Reset() {
+  Stop();
+  if (shuffle_) {
+    std::shuffle(order_.begin(), order_.end(), engine_);
+  }
+  error_ = nullptr;
+  pending_.clear();
+  drained_ = false;
+  Start();
+}
+
+ShardLoader::Batch ShardLoader::Next() {
+  if (batch_size_) {
+    return NextSamples();
+  }
+  std::optional<Loaded> loaded;
+  {
+    py::gil_scoped_release release{};
+    loaded = queue_->Pop();
+  }
+  if (!loaded) {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    return {};
+  }
+  auto bytes = loaded->samples * output_->SampleSize();
+  return {View(loaded->data, loaded->samples, loaded->keep),
+          View(loaded->data + bytes, loaded->samples, loaded->keep)};
+}
+
+std::size_t ShardLoader::Chunks() const noexcept {
+  return order_.size();
+}
+
+std::size_t ShardLoader::Samples() const noexcept {
+  return samples_;
+}
+
+std::size_t ShardLoader::Batches() const noexcept {
+  return batch_size_ ? (samples_ + batch_size_ - 1) / batch_size_
+                     : order_.size();
+}
+
+// Copies up to `batch_size_` samples into pooled buffers, taking them in
+// order or, with shuffle, at random from the pending samples.
+ShardLoader::Batch ShardLoader::NextSamples() {
+  auto size = output_->SampleSize();
+  auto x = batch_ring_->Acquire();
+  auto y = batch_ring_->Acquire();
+  std::size_t n = 0;
+  {
+    py::gil_scoped_release release{};
+    for (; n < batch_size_; ++n) {
+      Refill();
+      if (pending_.empty()) {
+        break;
+      }
+      if (shuffle_) {
+        auto i = std::uniform_int_distribution<std::size_t>{
+            0, pending_.size() - 1}(engine_);
+        std::swap(pending_[i], pending_.front());
+      }
+      auto [chunk, index] = std::move(pending_.front());
+      pending_.pop_front();
+      auto data = chunk->data + index * size;
+      std::memcpy(x.get() + n * size, data, size);
+      std::memcpy(y.get() + n * size, data + chunk->samples * size, size);
+    }
+  }
+  if (n == 0) {
+    batch_ring_->Release(std::move(x));
+    batch_ring_->Release(std::move(y));
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    return {};
+  }
+  return {output_->Wrap(std::move(x), static_cast<int>(n), batch_ring_),
+          output_->Wrap(std::move(y), static_cast<int>(n), batch_ring_)};
+}
+
+// Takes chunks off the queue while fewer than `window_` chunks of samples
+// are pending.
+void ShardLoader::Refill() {
+  while (!drained_ && pending_.size() < window_ * chunk_size_) {
+    auto loaded = queue_->Pop();
+    if (!loaded) {
+      drained_ = true;
+      return;
+    }
+    auto chunk = std::make_shared<Loaded>(std::move(*loaded));
+    for (std::size_t i = 0; i < chunk->samples; ++i) {
+      pending_.emplace_back(chunk, i);
+    }
+  }
+}
+
+void ShardLoader::Open(const std::string& path) {
+  auto file = std::make_shared<MappedFileSource>(path);
+  auto data = file->Data();
+  auto size = file->Size();
+  ShardHeader header{};
+  if (size < sizeof(header)) {
+    Throw(path, " is not a shard");
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    Throw(path, " is not a shard");
+  }
+  auto compression = static_cast<Compression>(header.compression);
+  CheckCompression(compression);
+  if (!output_) {
+    output_.emplace(static_cast<Layout>(header.layout),
+                    static_cast<DType>(header.dtype), header.width,
+                    header.height);
+    chunk_size_ = header.chunk_size;
+  } else {
+    ShardHeader first{};
+    std::memcpy(&first, shards_.front().file->Data(), sizeof(first));
+    if (header.layout != first.layout || header.dtype != first.dtype ||
+        header.width != first.width || header.height != first.height ||
+        header.chunk_size != first.chunk_size) {
+      Throw(path, " does not match the format of the other shards");
+    }
+  }
+  if (size < header.index_offset ||
+      (size - header.index_offset) / sizeof(ShardChunk) < header.chunks) {
+    Throw(path, " is truncated");
+  }
+  auto index = data + header.index_offset;
+  for (std::size_t i = 0; i < header.chunks; ++i) {
+    ShardChunk chunk{};
+    std::memcpy(&chunk, index + i * sizeof(chunk), sizeof(chunk));
+    auto raw = 2 * chunk.samples * output_->SampleSize();
+    if (header.index_offset < chunk.offset ||
+        header.index_offset - chunk.offset < chunk.size ||
+        chunk.samples == 0 || chunk_size_ < chunk.samples ||
+        (compression == Compression::NONE && chunk.size != raw)) {
+      Throw(path, " has a corrupt chunk index");
+    }
+    order_.emplace_back(shards_.size(), i);
+  }
+  if (shuffle_) {
+    madvise(const_cast<uint8_t*>(data), size, MADV_RANDOM);
+  }
+  samples_ += header.samples;
+  shards_.push_back(Shard{std::move(file), index, compression});
+}
+
+void ShardLoader::Start() {
+  queue_ = std::make_unique<BoundedQueue<Loaded>>(window_);
+  reader_ = std::thread{&ShardLoader::ReadAhead, this};
+}
+
+void ShardLoader::Stop() noexcept {
+  if (queue_) {
+    queue_->Close();
+  }
+  if (reader_.joinable()) {
+    reader_.join();
+  }
+}
+
+void ShardLoader::ReadAhead() noexcept {
+  try {
+    auto group = pool_ ? pool_->Size() : 1;
+    std::vector<Loaded> loaded;
+    for (std::size_t begin = 0; begin < order_.size(); begin += group) {
+      auto count = std::min(group, order_.size() - begin);
+      loaded.assign(count, Loaded{});
+      auto load = [&](std::size_t i, std::size_t) {
+        auto [shard, chunk] = order_[begin + i];
+        loaded[i] = Load(shard, chunk);
+      };
+      if (pool_) {
+        pool_->ParallelFor(count, load);
+      } else {
+        load(0, 0);
+      }
+      for (auto& item : loaded) {
+        if (!queue_->Push(std::move(item))) {
+          return;
+        }
+      }
+    }
+  } catch (...) {
+    error_ = std::current_exception();
+  }
+  queue_->Close();
+}
+
+ShardLoader::Loaded ShardLoader::Load(std::size_t shard, std::size_t chunk) {
+  auto& s = shards_[shard];
+  ShardChunk entry{};
+  std::memcpy(&entry, s.index + chunk * sizeof(entry), sizeof(entry));
+  auto data = s.file->Data() + entry.offset;
+  if (s.compression == Compression::NONE) {
+    WillNeed(data, entry.size);
+    return Loaded{data, entry.samples, s.file};
+  }
+  std::shared_ptr<uint8_t> buffer{
+      ring_->Acquire().release(), [ring = ring_](uint8_t* p) {
+        ring->Release(std::unique_ptr<uint8_t[]>{p});
+      }};
+  Decompress(s.compression, data, entry.size, buffer.get(),
+             2 * entry.samples * output_->SampleSize());
+  return Loaded{buffer.get(), entry.samples, buffer};
+}
+
+py::array ShardLoader::View(const uint8_t* data, std::size_t samples,
+                            const std::shared_ptr<void>& keep) const {
+  py::capsule base{new std::shared_ptr<void>{keep}, [](void* p) {
+                     delete static_cast<std::shared_ptr<void>*>(p);
+                   }};
+  py::array array{output_->NumpyType(), output_->Shape(samples), data, base};
+  array.attr("setflags")(py::arg("write") = false);
+  return array;
+}
+
+void ShardWriter::Register(py::module_& m) {
+  py::enum_<Compression>(m, "Compression")
+      .value("NONE", Compression::NONE)
+      .value("LZ4", Compression::LZ4)
+      .value("ZSTD", Compression::ZSTD);
+
+  auto c = py::class_<ShardWriter>(m, "ShardWriter");
+
+  c.def(py::init([](std::string prefix, std::pair<int, int> size,
+                    Layout layout, DType dtype, std::size_t chunk_size,
+                    std::size_t shard_chunks, Compression compression,
+                    int level) {
+          py::gil_scoped_release release{};
+          return std::make_unique<ShardWriter>(
+              std::move(prefix), layout, dtype, size.first, size.second,
+              chunk_size, shard_chunks, compression, level);
+        }),
+        py::arg("prefix"), py::arg("frame_size") = std::pair{1280, 720},
+        py::arg("layout") = Layout::RGBA, py::arg("dtype") = DType::UINT8,
+        py::arg("chunk_size") = 32, py::arg("shard_chunks") = 256,
+        py::arg("compression") = Compression::NONE, py::arg("level") = 0);
+
+  c.def(
+      "write",
+      [](ShardWriter& w, const py::array& x, const py::array& y) {
+        ExclusiveScope scope{&w};
+        if (!(x.flags() & py::array::c_style) ||
+            !(y.flags() & py::array::c_style)) {
+          Throw("samples must be C-contiguous");
+        }
+        auto size = w.SampleSize();
+        auto bytes = static_cast<std::size_t>(x.nbytes());
+        if (static_cast<std::size_t>(x.itemsize()) !=
+                w.output_.ElementSize() ||
+            static_cast<std::size_t>(y.itemsize()) !=
+                w.output_.ElementSize()) {
+          Throw("samples have item size ", x.itemsize(), ", expected ",
+                w.output_.ElementSize());
+        }
+        if (static_cast<std::size_t>(y.nbytes()) != bytes ||
+            bytes % size != 0) {
+          Throw("arrays of ", bytes, " and ", y.nbytes(),
+                " bytes do not hold the same whole samples of ", size,
+                " bytes");
+        }
+        auto xp = static_cast<const uint8_t*>(x.data());
+        auto yp = static_cast<const uint8_t*>(y.data());
+        py::gil_scoped_release release{};
+        for (std::size_t i = 0; i < bytes / size; ++i) {
+          w.Write(xp + i * size, yp + i * size);
+        }
+      },
+      py::arg("x"), py::arg("y"));
+  c.def(
+      "write_from",
+      [](ShardWriter& w, Generator& g, std::size_t samples) {
+        ExclusiveScope writer{&w};
+        ExclusiveScope generator{&g};
+        py::gil_scoped_release release{};
+        return w.WriteFrom(g, samples);
+      },
+      py::arg("generator"), py::arg("samples"));
+  c.def("close", Exclusive(&ShardWriter::Close));
+  c.def_property_readonly("paths", &ShardWriter::Paths);
+  c.def("__enter__", [](py::object self) { return self; });
+  c.def("__exit__", [](ShardWriter& w, py::args) {
+    ExclusiveScope scope{&w};
+    py::gil_scoped_release release{};
+    w.Close();
+  });
+}
+
+void ShardLoader::Register(py::module_& m) {
+  auto c = py::class_<ShardLoader>(m, "ShardLoader");
+
+  c.def(py::init([](const std::vector<std::string>& paths, bool shuffle,
+                    std::optional<unsigned> seed, std::size_t window,
+                    std::size_t threads, std::size_t batch_size) {
+          py::gil_scoped_release release{};
+          return std::make_unique<ShardLoader>(paths, shuffle, seed, window,
+                                               threads, batch_size);
+        }),
+        py::arg("paths"), py::arg("shuffle") = false,
+        py::arg("seed") = py::none{}, py::arg("window") = 4,
+        py::arg("threads") = 0, py::arg("batch_size") = 0);
+
+  c.def("reset", Exclusive(&ShardLoader::Reset));
+  c.def("next_batch", [](ShardLoader& l) {
+    ExclusiveScope scope{&l};
+    return l.Next();
+  });
+  c.def("__iter__", [](py::object self) { return self; });
+  c.def("__next__", [](ShardLoader& l) {
+    ExclusiveScope scope{&l};
+    auto [x, y] = l.Next();
+    if (!x) {
+      throw py::stop_iteration{};
+    }
+    return py::make_tuple(std::move(*x), std::move(*y));
+  });
+  c.def("__len__", &ShardLoader::Batches);
+  c.def_property_readonly("chunks", &ShardLoader::Chunks);
+  c.def_property_readonly("samples", &ShardLoader::Samples);
+}
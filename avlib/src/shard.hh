@@ -0,0 +1,168 @@
+#pragma once
+
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "buffer_ring.hh"
+#include "common.hh"
+#include "generator.hh"
+#include "io_source.hh"
+#include "layout_converter.hh"
+#include "queue.hh"
+#include "thread_pool.hh"
+
+// Codecs are available if the library was built against libzstd or liblz4.
+enum class Compression : int {
+  NONE,
+  LZ4,
+  ZSTD,
+};
+
+// Index entry of a chunk: file offset, stored size and sample count.
+struct ShardChunk {
+  uint64_t offset;
+  uint64_t size;
+  uint64_t samples;
+};
+
+// Dataset shards of (x, y) samples in a fixed layout and dtype. A shard is a
+// header, chunks of up to `chunk_size` samples and a chunk index. A chunk
+// holds its x samples followed by its y samples, starts 64-byte aligned and
+// is compressed as a whole if at all, so an uncompressed chunk can be handed
+// out as two arrays viewing the mapped file.
+class ShardWriter {
+ public:
+  // Shards are named `prefix`-00000.avs, -00001.avs, ... and hold up to
+  // `shard_chunks` chunks each. A shard is written to a temporary file that
+  // is renamed once complete. `level` is the zstd level or the LZ4
+  // acceleration, zero picking the codec default.
+  explicit ShardWriter(std::string prefix, Layout layout, DType dtype,
+                       int width, int height, std::size_t chunk_size = 32,
+                       std::size_t shard_chunks = 256,
+                       Compression compression = Compression::NONE,
+                       int level = 0);
+  ShardWriter(const ShardWriter& other) = delete;
+  ShardWriter& operator=(const ShardWriter& other) = delete;
+  // Completes the open shard; errors are only reported by Close.
+  ~ShardWriter() noexcept;
+
+  void Write(const uint8_t* x, const uint8_t* y);
+  // Writes up to `samples` samples of a generator without prefetch. Returns
+  // the number written, fewer if the generator ran out.
+  std::size_t WriteFrom(Generator& generator, std::size_t samples);
+  void Close();
+  const std::vector<std::string>& Paths() const noexcept;
+  std::size_t SampleSize() const noexcept;
+
+  static void Register(py::module_& m);
+
+ private:
+  std::string prefix_;
+  LayoutConverter output_;
+  Layout layout_;
+  DType dtype_;
+  int width_;
+  int height_;
+  Compression compression_;
+  int level_;
+  std::size_t chunk_size_;
+  std::size_t shard_chunks_;
+  std::vector<uint8_t> chunk_;
+  std::size_t filled_{0};
+  std::ofstream out_;
+  std::string path_;
+  std::string temp_;
+  std::vector<ShardChunk> index_;
+  std::vector<std::string> paths_;
+
+  void OpenShard();
+  void FlushChunk();
+  void CloseShard();
+  void WriteHeader(uint64_t index_offset);
+};
+
+// Reads shards through memory mappings. A reader thread keeps up to
+// `window` chunks ahead of the consumer, advising the kernel to page in
+// mapped chunks or decompressing them on a thread pool. With `shuffle`,
+// every epoch visits the chunks of all shards in a new random order.
+//
+// Without a `batch_size`, every chunk is a batch: read-only arrays viewing
+// the mapping if uncompressed. Such batches always hold the same
+// consecutive samples of one generator run, only their order changes.
+// With a `batch_size`, samples are copied into pooled batch buffers and,
+// with `shuffle`, drawn at random from the samples of the `window` chunks
+// read last, so batches mix samples of different chunks and epochs.
+class ShardLoader {
+ public:
+  using Batch = Generator::Batch;
+
+  explicit ShardLoader(const std::vector<std::string>& paths,
+                       bool shuffle = false,
+                       std::optional<unsigned> seed = std::nullopt,
+                       std::size_t window = 4, std::size_t threads = 0,
+                       std::size_t batch_size = 0);
+  ShardLoader(const ShardLoader& other) = delete;
+  ShardLoader& operator=(const ShardLoader& other) = delete;
+  ~ShardLoader() noexcept;
+
+  // Starts the next epoch.
+  void Reset();
+  // Returns (None, None) at the end of the epoch.
+  Batch Next();
+  std::size_t Chunks() const noexcept;
+  std::size_t Samples() const noexcept;
+  std::size_t Batches() const noexcept;
+
+  static void Register(py::module_& m);
+
+ private:
+  struct Shard {
+    std::shared_ptr<MappedFileSource> file;
+    const uint8_t* index;
+    Compression compression;
+  };
+
+  struct Loaded {
+    const uint8_t* data;
+    std::size_t samples;
+    // Owner of `data`: the mapping or a pooled decompression buffer.
+    std::shared_ptr<void> keep;
+  };
+
+  std::vector<Shard> shards_;
+  std::vector<std::pair<std::size_t, std::size_t>> order_;
+  std::optional<LayoutConverter> output_;
+  std::size_t chunk_size_{0};
+  std::size_t samples_{0};
+  bool shuffle_;
+  std::default_random_engine engine_;
+  std::size_t window_;
+  std::unique_ptr<ThreadPool> pool_;
+  std::shared_ptr<BufferRing> ring_;
+  std::unique_ptr<BoundedQueue<Loaded>> queue_;
+  std::thread reader_;
+  std::exception_ptr error_;
+  std::size_t batch_size_;
+  std::shared_ptr<BufferRing> batch_ring_;
+  // Samples left of the chunks taken from the queue, by chunk and index.
+  std::deque<std::pair<std::shared_ptr<Loaded>, std::size_t>> pending_;
+  bool drained_{false};
+
+  void Open(const std::string& path);
+  void Start();
+  void Stop() noexcept;
+  void ReadAhead() noexcept;
+  Loaded Load(std::size_t shard, std::size_t chunk);
+  Batch NextSamples();
+  void Refill();
+  py::array View(const uint8_t* data, std::size_t samples,
+                 const std::shared_ptr<void>& keep) const;
+};
@@ -0,0 +1,77 @@
+#include "thread_pool.hh"
+
+#include <algorithm>
+#include <utility>
+
+ThreadPool::ThreadPool(std::size_t threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads_.reserve(threads);
+  for (std::size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back(&ThreadPool::Work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() noexcept {
+  {
+    std::lock_guard lock{mutex_};
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::ParallelFor(std::size_t count, const Task& task) {
+  if (count == 0) {
+    return;
+  }
+  std::unique_lock lock{mutex_};
+  task_ = &task;
+  count_ = count;
+  next_ = 0;
+  running_ = threads_.size();
+  error_ = nullptr;
+  ++generation_;
+  start_.notify_all();
+  done_.wait(lock, [&] { return running_ == 0; });
+  task_ = nullptr;
+  if (error_) {
+    std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+}
+
+std::size_t ThreadPool::Size() const noexcept {
+  return threads_.size();
+}
+
+void ThreadPool::Work(std::size_t worker) noexcept {
+  std::size_t seen = 0;
+  for (;;) {
+    std::unique_lock lock{mutex_};
+    start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+    if (stop_) {
+      return;
+    }
+    seen = generation_;
+    auto task = task_;
+    auto count = count_;
+    lock.unlock();
+    for (auto i = next_++; i < count; i = next_++) {
+      try {
+        (*task)(i, worker);
+      } catch (...) {
+        std::lock_guard guard{mutex_};
+        if (!error_) {
+          error_ = std::current_exception();
+        }
+      }
+    }
+    lock.lock();
+    if (--running_ == 0) {
+      done_.notify_all();
+    }
+  }
+}
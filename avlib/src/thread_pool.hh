@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running one ParallelFor at a time. Not reentrant: a
+// pool must be driven by one thread.
+class ThreadPool {
+ public:
+  using Task = std::function<void(std::size_t index, std::size_t worker)>;
+
+  // Zero threads picks the number of cores.
+  explicit ThreadPool(std::size_t threads = 0);
+  ThreadPool(const ThreadPool& other) = delete;
+  ThreadPool& operator=(const ThreadPool& other) = delete;
+  ~ThreadPool() noexcept;
+
+  // Runs `task` for every index in [0, count) and waits for all of them.
+  // `worker` identifies the calling thread, so per-thread state can be
+  // indexed by it. Rethrows the first exception after all tasks finished.
+  void ParallelFor(std::size_t count, const Task& task);
+  std::size_t Size() const noexcept;
+
+ private:
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const Task* task_{nullptr};
+  std::size_t count_{0};
+  std::atomic<std::size_t> next_{0};
+  std::size_t running_{0};
+  std::size_t generation_{0};
+  std::exception_ptr error_;
+  bool stop_{false};
+
+  void Work(std::size_t worker) noexcept;
+};
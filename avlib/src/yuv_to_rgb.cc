@@ -0,0 +1,261 @@
+#include "yuv_to_rgb.hh"
+
+#include <cmath>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_KERNELS 1
+#else
+#define X86_KERNELS 0
+#endif
+
+static int Channels(YuvToRgb::Layout layout) {
+  return layout == YuvToRgb::Layout::RGBA || layout == YuvToRgb::Layout::BGRA
+             ? 4
+             : 3;
+}
+
+static bool SwapsRedBlue(YuvToRgb::Layout layout) {
+  return layout == YuvToRgb::Layout::BGRA || layout == YuvToRgb::Layout::BGR24;
+}
+
+static uint8_t Clamp(int value) {
+  return value < 0 ? 0 : (255 < value ? 255 : value);
+}
+
+static void RowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                      int uv_step, uint8_t* dst, int width,
+                      const YuvToRgb::Coefficients& c,
+                      YuvToRgb::Layout layout) {
+  auto channels = Channels(layout);
+  auto r_i = SwapsRedBlue(layout) ? 2 : 0;
+  auto b_i = 2 - r_i;
+  for (int x = 0; x < width; ++x, dst += channels) {
+    auto yy = (((y[x] - c.y_offset) * 64 * c.y) >> 16) + 4;
+    auto uu = (u[x / 2 * uv_step] - 128) * 64;
+    auto vv = (v[x / 2 * uv_step] - 128) * 64;
+    dst[r_i] = Clamp((yy + ((vv * c.v_r) >> 16)) >> 3);
+    dst[1] = Clamp((yy - ((uu * c.u_g) >> 16) - ((vv * c.v_g) >> 16)) >> 3);
+    dst[b_i] = Clamp((yy + ((uu * c.u_b) >> 16)) >> 3);
+    if (channels == 4) {
+      dst[3] = 255;
+    }
+  }
+}
+
+#if X86_KERNELS
+
+// Interleaves 16 pixels of R, G and B. Packed RGB is written with
+// overlapping 16-byte stores that run 4 bytes past the last pixel. Forced
+// inline so the AVX2 kernel does not call into non-VEX code.
+__attribute__((target("sse4.1"), always_inline)) static inline void Store(
+    uint8_t* dst, __m128i r, __m128i g, __m128i b, YuvToRgb::Layout layout) {
+  if (SwapsRedBlue(layout)) {
+    std::swap(r, b);
+  }
+  auto a = _mm_set1_epi8(-1);
+  auto rg_lo = _mm_unpacklo_epi8(r, g);
+  auto rg_hi = _mm_unpackhi_epi8(r, g);
+  auto ba_lo = _mm_unpacklo_epi8(b, a);
+  auto ba_hi = _mm_unpackhi_epi8(b, a);
+  __m128i pixels[] = {
+      _mm_unpacklo_epi16(rg_lo, ba_lo), _mm_unpackhi_epi16(rg_lo, ba_lo),
+      _mm_unpacklo_epi16(rg_hi, ba_hi), _mm_unpackhi_epi16(rg_hi, ba_hi)};
+  if (Channels(layout) == 4) {
+    for (int i = 0; i < 4; ++i) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16 * i), pixels[i]);
+    }
+    return;
+  }
+  auto drop_alpha =
+      _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  for (int i = 0; i < 4; ++i) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 12 * i),
+                     _mm_shuffle_epi8(pixels[i], drop_alpha));
+  }
+}
+
+// Loads the chroma of 16 pixels with every sample duplicated.
+__attribute__((target("sse4.1"), always_inline)) static inline void
+LoadChroma(const uint8_t* u, const uint8_t* v, int uv_step, int x,
+           __m128i& u8, __m128i& v8) {
+  if (uv_step == 2) {
+    auto uv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x));
+    u8 = _mm_shuffle_epi8(uv, _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6, 8, 8, 10,
+                                            10, 12, 12, 14, 14));
+    v8 = _mm_shuffle_epi8(uv, _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11,
+                                            11, 13, 13, 15, 15));
+    return;
+  }
+  u8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x / 2));
+  v8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x / 2));
+  u8 = _mm_unpacklo_epi8(u8, u8);
+  v8 = _mm_unpacklo_epi8(v8, v8);
+}
+
+__attribute__((target("sse4.1"))) static void RowSse4(
+    const uint8_t* y, const uint8_t* u, const uint8_t* v, int uv_step,
+    uint8_t* dst, int width, const YuvToRgb::Coefficients& c,
+    YuvToRgb::Layout layout) {
+  auto channels = Channels(layout);
+  auto slack = channels == 3 ? 2 : 0;
+  auto y_offset = _mm_set1_epi16(c.y_offset);
+  auto uv_offset = _mm_set1_epi16(128);
+  auto round = _mm_set1_epi16(4);
+  auto y_gain = _mm_set1_epi16(c.y);
+  auto v_r = _mm_set1_epi16(c.v_r);
+  auto u_g = _mm_set1_epi16(c.u_g);
+  auto v_g = _mm_set1_epi16(c.v_g);
+  auto u_b = _mm_set1_epi16(c.u_b);
+  int x = 0;
+  for (; x + 16 + slack <= width; x += 16) {
+    auto y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+    __m128i u8, v8;
+    LoadChroma(u, v, uv_step, x, u8, v8);
+    __m128i r[2], g[2], b[2];
+    for (int h = 0; h < 2; ++h) {
+      auto yy = _mm_cvtepu8_epi16(h ? _mm_srli_si128(y8, 8) : y8);
+      auto uu = _mm_cvtepu8_epi16(h ? _mm_srli_si128(u8, 8) : u8);
+      auto vv = _mm_cvtepu8_epi16(h ? _mm_srli_si128(v8, 8) : v8);
+      yy = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(yy, y_offset), 6),
+                           y_gain);
+      yy = _mm_add_epi16(yy, round);
+      uu = _mm_slli_epi16(_mm_sub_epi16(uu, uv_offset), 6);
+      vv = _mm_slli_epi16(_mm_sub_epi16(vv, uv_offset), 6);
+      r[h] = _mm_srai_epi16(_mm_add_epi16(yy, _mm_mulhi_epi16(vv, v_r)), 3);
+      g[h] = _mm_srai_epi16(
+          _mm_sub_epi16(_mm_sub_epi16(yy, _mm_mulhi_epi16(uu, u_g)),
+                        _mm_mulhi_epi16(vv, v_g)),
+          3);
+      b[h] = _mm_srai_epi16(_mm_add_epi16(yy, _mm_mulhi_epi16(uu, u_b)), 3);
+    }
+    Store(dst + x * channels, _mm_packus_epi16(r[0], r[1]),
+          _mm_packus_epi16(g[0], g[1]), _mm_packus_epi16(b[0], b[1]), layout);
+  }
+  RowScalar(y + x, u + x / 2 * uv_step, v + x / 2 * uv_step, uv_step,
+            dst + x * channels, width - x, c, layout);
+}
+
+__attribute__((target("avx2"))) static void RowAvx2(
+    const uint8_t* y, const uint8_t* u, const uint8_t* v, int uv_step,
+    uint8_t* dst, int width, const YuvToRgb::Coefficients& c,
+    YuvToRgb::Layout layout) {
+  auto channels = Channels(layout);
+  auto slack = channels == 3 ? 2 : 0;
+  auto y_offset = _mm256_set1_epi16(c.y_offset);
+  auto uv_offset = _mm256_set1_epi16(128);
+  auto round = _mm256_set1_epi16(4);
+  auto y_gain = _mm256_set1_epi16(c.y);
+  auto v_r = _mm256_set1_epi16(c.v_r);
+  auto u_g = _mm256_set1_epi16(c.u_g);
+  auto v_g = _mm256_set1_epi16(c.v_g);
+  auto u_b = _mm256_set1_epi16(c.u_b);
+  int x = 0;
+  for (; x + 16 + slack <= width; x += 16) {
+    __m128i u8, v8;
+    LoadChroma(u, v, uv_step, x, u8, v8);
+    auto yy = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x)));
+    auto uu = _mm256_cvtepu8_epi16(u8);
+    auto vv = _mm256_cvtepu8_epi16(v8);
+    yy = _mm256_mulhi_epi16(
+        _mm256_slli_epi16(_mm256_sub_epi16(yy, y_offset), 6), y_gain);
+    yy = _mm256_add_epi16(yy, round);
+    uu = _mm256_slli_epi16(_mm256_sub_epi16(uu, uv_offset), 6);
+    vv = _mm256_slli_epi16(_mm256_sub_epi16(vv, uv_offset), 6);
+    auto r =
+        _mm256_srai_epi16(_mm256_add_epi16(yy, _mm256_mulhi_epi16(vv, v_r)), 3);
+    auto g = _mm256_srai_epi16(
+        _mm256_sub_epi16(_mm256_sub_epi16(yy, _mm256_mulhi_epi16(uu, u_g)),
+                         _mm256_mulhi_epi16(vv, v_g)),
+        3);
+    auto b =
+        _mm256_srai_epi16(_mm256_add_epi16(yy, _mm256_mulhi_epi16(uu, u_b)), 3);
+    // packus works per 128-bit lane; reorder to R | G and B | B.
+    auto rg = _mm256_permute4x64_epi64(_mm256_packus_epi16(r, g), 0xD8);
+    auto bb = _mm256_permute4x64_epi64(_mm256_packus_epi16(b, b), 0xD8);
+    Store(dst + x * channels, _mm256_castsi256_si128(rg),
+          _mm256_extracti128_si256(rg, 1), _mm256_castsi256_si128(bb), layout);
+  }
+  RowScalar(y + x, u + x / 2 * uv_step, v + x / 2 * uv_step, uv_step,
+            dst + x * channels, width - x, c, layout);
+}
+
+#endif
+
+static YuvToRgb::Row SelectRow() {
+#if X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return &RowAvx2;
+  }
+  if (__builtin_cpu_supports("sse4.1")) {
+    return &RowSse4;
+  }
+#endif
+  return &RowScalar;
+}
+
+static YuvToRgb::Layout ToLayout(AVPixelFormat format) {
+  switch (format) {
+    case AV_PIX_FMT_BGRA:
+      return YuvToRgb::Layout::BGRA;
+    case AV_PIX_FMT_RGB24:
+      return YuvToRgb::Layout::RGB24;
+    case AV_PIX_FMT_BGR24:
+      return YuvToRgb::Layout::BGR24;
+    default:
+      return YuvToRgb::Layout::RGBA;
+  }
+}
+
+YuvToRgb::YuvToRgb(AVPixelFormat src, AVPixelFormat dst, AVColorSpace space,
+                   AVColorRange range)
+    : coefficients_{Compute(space, range == AVCOL_RANGE_JPEG ||
+                                       src == AV_PIX_FMT_YUVJ420P)},
+      layout_{ToLayout(dst)},
+      uv_step_{src == AV_PIX_FMT_NV12 ? 2 : 1} {
+  static const Row row = SelectRow();
+  row_ = row;
+}
+
+bool YuvToRgb::Supported(AVPixelFormat src, AVPixelFormat dst) noexcept {
+  auto yuv = src == AV_PIX_FMT_YUV420P || src == AV_PIX_FMT_YUVJ420P ||
+             src == AV_PIX_FMT_NV12;
+  auto rgb = dst == AV_PIX_FMT_RGBA || dst == AV_PIX_FMT_BGRA ||
+             dst == AV_PIX_FMT_RGB24 || dst == AV_PIX_FMT_BGR24;
+  return yuv && rgb;
+}
+
+// BT.709 for streams tagged as such, BT.601 otherwise, which is also what
+// swscale assumes for untagged input.
+YuvToRgb::Coefficients YuvToRgb::Compute(AVColorSpace space,
+                                         bool full_range) noexcept {
+  auto bt709 = space == AVCOL_SPC_BT709;
+  auto kr = bt709 ? 0.2126 : 0.299;
+  auto kb = bt709 ? 0.0722 : 0.114;
+  auto kg = 1.0 - kr - kb;
+  auto y_scale = full_range ? 1.0 : 255.0 / 219.0;
+  auto c_scale = full_range ? 1.0 : 255.0 / 224.0;
+  auto q13 = [](double value) {
+    return static_cast<int16_t>(std::lround(value * 8192.0));
+  };
+  return {static_cast<int16_t>(full_range ? 0 : 16),
+          q13(y_scale),
+          q13(2.0 * (1.0 - kr) * c_scale),
+          q13(2.0 * kb * (1.0 - kb) / kg * c_scale),
+          q13(2.0 * kr * (1.0 - kr) / kg * c_scale),
+          q13(2.0 * (1.0 - kb) * c_scale)};
+}
+
+void YuvToRgb::Convert(const AVFrame* src, uint8_t* const dst_data[],
+                       const int dst_stride[]) const {
+  for (int row = 0; row < src->height; ++row) {
+    auto y = src->data[0] + row * src->linesize[0];
+    auto u = src->data[1] + row / 2 * src->linesize[1];
+    auto v = uv_step_ == 2 ? u + 1 : src->data[2] + row / 2 * src->linesize[2];
+    row_(y, u, v, uv_step_, dst_data[0] + row * dst_stride[0], src->width,
+         coefficients_, layout_);
+  }
+}
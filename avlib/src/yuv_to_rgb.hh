@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common.hh"
+
+// Same-size YUV420P/NV12 to packed RGB conversion with nearest chroma, the
+// way swscale's unscaled path does it. Rows are converted by SSE4.1 or AVX2
+// kernels chosen at runtime, with a scalar fallback; all kernels use the same
+// fixed point arithmetic and produce identical output.
+class YuvToRgb {
+ public:
+  enum class Layout : int { RGBA, BGRA, RGB24, BGR24 };
+
+  // Q13 gains applied to (Y - y_offset) and (C - 128), each shifted left
+  // by 6 bits before a 16-bit high multiply.
+  struct Coefficients {
+    int16_t y_offset;
+    int16_t y;
+    int16_t v_r;
+    int16_t u_g;
+    int16_t v_g;
+    int16_t u_b;
+  };
+
+  using Row = void (*)(const uint8_t* y, const uint8_t* u, const uint8_t* v,
+                       int uv_step, uint8_t* dst, int width,
+                       const Coefficients& c, Layout layout);
+
+  explicit YuvToRgb(AVPixelFormat src, AVPixelFormat dst, AVColorSpace space,
+                    AVColorRange range);
+
+  static bool Supported(AVPixelFormat src, AVPixelFormat dst) noexcept;
+  static Coefficients Compute(AVColorSpace space, bool full_range) noexcept;
+
+  void Convert(const AVFrame* src, uint8_t* const dst_data[],
+               const int dst_stride[]) const;
+
+ private:
+  Coefficients coefficients_;
+  Layout layout_;
+  int uv_step_;
+  Row row_;
+};
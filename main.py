@@ -51,7 +51,8 @@ def main():
   # model = make_model()
   model = keras.api.saving.load_model("model.keras")
   model.compile("adam", "mse")
-  generator = av.Generator("Fast.and.the.Furious.Tokyo.Drift.mp4", (1280, 720), 16)
+  generator = av.Generator("Fast.and.the.Furious.Tokyo.Drift.mp4", (1280, 720), 16,
+                           prefetch=2, ring=4, layout=av.Layout.RGB24)
   running = True
   while running:
     for i in range(50):
@@ -60,8 +61,6 @@ def main():
         print("end of stream ", i)
         running = False
         break
-      x = x[:, :, :, :3]
-      y = y[:, :, :, :3]
       logs = model.train_on_batch(x, y)
       print(logs)
     model.save("model.keras", overwrite=True)